@@ -11,9 +11,34 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
 
 #include <assert.h>
 
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#  define CSV_POSIX 1
+#  include <unistd.h>
+#elif defined(_WIN32)
+#  include <io.h>
+#endif
+
+/*
+ * If CSV_THREADS is non-zero (the default on POSIX systems), csv_save_ex()
+ * can format rows on several threads, and programs need to be linked with
+ * -lpthread. Compile with -DCSV_THREADS=0 to leave threads out.
+ */
+#ifndef CSV_POSIX
+#  undef CSV_THREADS
+#  define CSV_THREADS 0
+#elif !defined(CSV_THREADS)
+#  define CSV_THREADS 1
+#endif
+#if CSV_THREADS
+#  include <pthread.h>
+#endif
+
 #include "csv.h"
 #include "utils.h"
 
@@ -33,6 +58,9 @@
  */
 #define TRIM_SPACES 0
 
+/* The number of rows formatted at a time by each thread in csv_save_ex() */
+#define CSV_SAVE_ROWS 4096
+
 /* Various error codes */
 #define ER_OK		 		 1
 #define ER_MEM_FAIL  		-1
@@ -41,6 +69,7 @@
 #define ER_INV_PARAM 		-4
 #define ER_EXPECTED_EOS	 	-5
 #define ER_BAD_QUOTEEND		-6
+#define ER_BAD_FORMAT		-7
 
 static int csv_set_int(csv_file *csv, int row, int col, char *value);
 
@@ -55,6 +84,7 @@ const char *csv_errstr(int err)
 		case ER_INV_PARAM: return "Invalid parameter";
 		case ER_EXPECTED_EOS : return "Unterminated string";
 		case ER_BAD_QUOTEEND : return "Expected a field or record separator after the \"";
+		case ER_BAD_FORMAT : return "Not a valid columnar file";
 	}
 	return "Unknown";
 }
@@ -117,6 +147,60 @@ void csv_free(csv_file *csv)
 	free(csv);
 }
 
+/* Copies the unquoted field at `*p` and moves `*p` past it */
+static char *plain_field(char **p)
+{
+	char *q, *s;
+	
+#if TRIM_SPACES			
+	/* Trim leading whitespace */
+	while((*p)[0] == ' ' || (*p)[0] == '\t') (*p)++;
+#endif
+	for(q = *p; q[0] && q[0] != ',' && q[0] != '\r' && q[0] != '\n'; q++);
+	
+	s = my_slice_dup(my_slice_n(*p, q - *p));
+	if(!s)
+		return NULL;
+	*p = q;
+	
+#if TRIM_SPACES
+	/* Trim trailing whitespace */
+	for(q = s + strlen(s); q > s && (q[-1] == ' ' || q[-1] == '\t');)
+		*(--q) = '\0';
+#endif		
+	return s;
+}
+
+/* Parses text without any quotes by only splitting it on the
+ * field and record separators */
+static int load_plain(csv_file *csv, char *p, int *line)
+{
+	int r = 0, c = 0;
+	while(*p)
+	{
+		if(*p != ',' && *p != '\r' && *p != '\n')
+		{
+			char *s = plain_field(&p);
+			if(!s)
+				return ER_MEM_FAIL;
+			csv_set_int(csv, r, c, s);
+		}
+		if(*p == ',')
+		{
+			c++;
+			p++;
+		}
+		else if(*p)
+		{
+			r++;
+			c = 0;
+			p += (p[0] == '\r' && p[1] == '\n') ? 2 : 1;
+			if(line) (*line)++;
+		}
+	}
+	return ER_OK;
+}
+
 #define RETERR(code) do{if(err)*err = code;return NULL;}while(0)
 #define ERREND(code) do{if(err)*err = code;goto error;}while(0)
 
@@ -124,7 +208,8 @@ void csv_free(csv_file *csv)
 csv_file *csv_load(const char *filename, int *err, int *line)
 {
 	csv_file *csv;
-	char *buffer, *p;
+	my_filebuf fb;
+	char *p;
 	int r = 0, c = 0;
 	
 	if(err) *err = ER_OK;
@@ -142,23 +227,32 @@ csv_file *csv_load(const char *filename, int *err, int *line)
 	 * I Acknowledge that this is not the most efficient way of doing it,
 	 * but it does simplify the parsing somewhat.
 	 */
-	buffer = my_readfile(filename);
-	if(!buffer)
+	if(!my_loadfile(filename, &fb, MY_LOAD_SEQUENTIAL))
 		ERREND(ER_IOR_FAIL);
 	
-	for(p = buffer; *p;)
+	/* Most files don't contain any quotes, and don't need the rest */
+	if(!memchr(fb.data, '\"', fb.len))
+	{
+		int rc = load_plain(csv, fb.data, line);
+		if(rc != ER_OK)
+			ERREND(rc);
+		my_freefile(&fb);
+		return csv;
+	}
+	
+	for(p = fb.data; *p;)
 	{
-		if(strchr(" \t",p[0]))
+		if(p[0] == ' ' || p[0] == '\t')
 		{
 			/* This is to prevent space between the start of a field 
 			and a " from confusing the parser */
 			char *q;
-			for(q = p + 1; strchr(" \t",q[0]); q++);
+			for(q = p + 1; q[0] == ' ' || q[0] == '\t'; q++);
 			if(q[0] == '\"')
 				p = q;
 		}
 		
-		if(!strncmp(p,"\r\n", 2)) 
+		if(p[0] == '\r' && p[1] == '\n')
 		{
 			/* official line endings */
 			r++;
@@ -166,7 +260,7 @@ csv_file *csv_load(const char *filename, int *err, int *line)
 			p+=2;
 			if(line) (*line)++;
 		}
-		else if(strchr("\r\n",p[0]))
+		else if(p[0] == '\r' || p[0] == '\n')
 		{
 			/* alternative line endings */
 			r++;
@@ -211,8 +305,8 @@ csv_file *csv_load(const char *filename, int *err, int *line)
 			*t = '\0';				
 			
 			/* Skip any whitespace after the closing quote */
-			for(p++; p[0] && !strchr(",\r\n",p[0]);p++)
-				if(!strchr(" \t",p[0]))
+			for(p++; p[0] && p[0] != ',' && p[0] != '\r' && p[0] != '\n';p++)
+				if(p[0] != ' ' && p[0] != '\t')
 					ERREND(ER_BAD_QUOTEEND);
 			
 			csv_set_int(csv, r, c, s);
@@ -220,85 +314,308 @@ csv_file *csv_load(const char *filename, int *err, int *line)
 		else
 		{
 			/* A normal field */
-			char *q, *s, *t;
-			
-#if TRIM_SPACES			
-			/* Trim leading whitespace */
-			while(p[0] && strchr(" \t",p[0])) p++;
-#endif
-			for(q = p;q[0] && !strchr(",\r\n",q[0]); q++);				
-			
-			s = malloc(q - p + 1);
+			char *s = plain_field(&p);
 			if(!s)
 				ERREND(ER_MEM_FAIL);
-			t = s;
-			while(p < q)
-			{
-				*(t++) = *(p++);
-			}		
-			*t = '\0';
-			
-#if TRIM_SPACES
-			/* Trim trailing whitespace */
-			while(t > s && strchr(" \t",t[-1]))
-				*(--t) = '\0';
-#endif		
-				
 			csv_set_int(csv, r, c, s);
 		}
 	}
 		
-	free(buffer);
+	my_freefile(&fb);
 	return csv;
 	
 error:
+	my_freefile(&fb);
 	csv_free(csv);
 	return NULL;
 }
 
-/* Saves a CSV file to disk */
-int csv_save(csv_file *csv, const char *filename)
+/* A range of rows formatted into a buffer by csv_save_ex() */
+typedef struct save_chunk
 {
-	int r, c;	
-	FILE *f = stdout;
-	
-	if(!csv || !filename) return ER_INV_PARAM;
-	
-	f = fopen(filename, "w");
-	if(!f) return ER_IOW_FAIL;
-		
-	for(r = 0; r < csv->nrows; r++)
+	csv_file *csv;
+	int first, last;
+	char *buffer;
+	size_t len;
+	int done;
+} save_chunk;
+
+/* Formats the rows of a chunk into its buffer. The size of the
+ * buffer is calculated first so that it is only allocated once. */
+static void format_chunk(save_chunk *ch)
+{
+	csv_file *csv = ch->csv;
+	size_t len = 0, tlen = strlen(CSV_LINE_TERMINATOR);
+	int r, c;
+	char *p;
+
+	for(r = ch->first; r < ch->last; r++)
+	{
+		for(c = 0; c < csv->rows[r].ncols; c++)
+		{
+			const char *cell = csv->rows[r].cols[c];
+			size_t n;
+			if(!cell) continue;
+			n = strcspn(cell, ",\"\r\n");
+			if(cell[n])
+			{
+				const char *q;
+				len += 2;
+				for(q = cell + n; *q; q++, n++)
+					if(*q == '\"')
+						len++;
+			}
+			len += n;
+		}
+		if(csv->rows[r].ncols > 0)
+			len += csv->rows[r].ncols - 1;
+		len += tlen;
+	}
+
+	ch->buffer = malloc(len + 1);
+	if(!ch->buffer)
+		return;
+
+	p = ch->buffer;
+	for(r = ch->first; r < ch->last; r++)
 	{
 		for(c = 0; c < csv->rows[r].ncols; c++)
 		{
 			const char *cell = csv->rows[r].cols[c];
 			if(cell)
 			{
-				if(strpbrk(cell, ",\"\r\n"))
+				size_t n = strcspn(cell, ",\"\r\n");
+				if(cell[n])
 				{
-					const char *p;
-					fputc('\"',f);
-					for(p = cell; *p; p++)
+					*p++ = '\"';
+					for(; *cell; cell++)
 					{
-						if(*p == '\"')
-							fputc('\"', f);
-						fputc(*p, f);
+						if(*cell == '\"')
+							*p++ = '\"';
+						*p++ = *cell;
 					}
-					fputc('\"',f);
+					*p++ = '\"';
 				}
 				else
-					fputs(cell, f);
+				{
+					memcpy(p, cell, n);
+					p += n;
+				}
 			}
-			
 			if(c < csv->rows[r].ncols - 1)
-				fputc(',',f);
+				*p++ = ',';
 		}
-		fputs(CSV_LINE_TERMINATOR,f);
+		memcpy(p, CSV_LINE_TERMINATOR, tlen);
+		p += tlen;
 	}
-	
+	ch->len = p - ch->buffer;
+	assert(ch->len == len);
+}
+
+/* Sets up chunk number k of a CSV file and formats it */
+static void format_nth_chunk(save_chunk *ch, csv_file *csv, int k)
+{
+	ch->csv = csv;
+	ch->first = k * CSV_SAVE_ROWS;
+	ch->last = MY_MIN(ch->first + CSV_SAVE_ROWS, csv->nrows);
+	ch->buffer = NULL;
+	format_chunk(ch);
+}
+
+/* Writes a formatted chunk to a file and frees its buffer */
+static int write_chunk(save_chunk *ch, FILE *f)
+{
+	int rv = ER_OK;
+	if(!ch->buffer)
+		return ER_MEM_FAIL;
+	if(fwrite(ch->buffer, 1, ch->len, f) != ch->len)
+		rv = ER_IOW_FAIL;
+	free(ch->buffer);
+	ch->buffer = NULL;
+	return rv;
+}
+
+#if CSV_THREADS
+/* The state shared by the threads of csv_save_ex().
+ * Chunk k is formatted into slots[k % nslots]; a worker may only
+ * start on it once chunk k - nslots has been written. */
+typedef struct save_pool
+{
+	csv_file *csv;
+	save_chunk *slots;
+	int nslots, nchunks;
+	int next_format, next_write;
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t formatted, written;
+} save_pool;
+
+/* A thread of csv_save_ex() that formats chunks until there are none left */
+static void *save_worker(void *arg)
+{
+	save_pool *pool = arg;
+	pthread_mutex_lock(&pool->lock);
+	for(;;)
+	{
+		save_chunk *ch;
+		int k;
+
+		while(!pool->stop && pool->next_format < pool->nchunks
+				&& pool->next_format >= pool->next_write + pool->nslots)
+			pthread_cond_wait(&pool->written, &pool->lock);
+		if(pool->stop || pool->next_format >= pool->nchunks)
+			break;
+
+		k = pool->next_format++;
+		ch = &pool->slots[k % pool->nslots];
+		pthread_mutex_unlock(&pool->lock);
+
+		format_nth_chunk(ch, pool->csv, k);
+
+		pthread_mutex_lock(&pool->lock);
+		ch->done = 1;
+		pthread_cond_signal(&pool->formatted);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+/* Formats the chunks on nthreads threads while this thread writes
+ * them to the file in order. Returns 0 if no thread could be started. */
+static int save_threaded(csv_file *csv, FILE *f, int nchunks, int nthreads)
+{
+	save_pool pool;
+	pthread_t *threads;
+	int i, k, started = 0, rv = ER_OK;
+
+	memset(&pool, 0, sizeof pool);
+	pool.csv = csv;
+	pool.nchunks = nchunks;
+	pool.nslots = 2 * nthreads;
+	pool.slots = calloc(pool.nslots, sizeof *pool.slots);
+	threads = calloc(nthreads, sizeof *threads);
+	if(!pool.slots || !threads)
+	{
+		free(pool.slots);
+		free(threads);
+		return ER_MEM_FAIL;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.formatted, NULL);
+	pthread_cond_init(&pool.written, NULL);
+
+	for(i = 0; i < nthreads; i++)
+		if(!pthread_create(&threads[started], NULL, save_worker, &pool))
+			started++;
+
+	if(started)
+	{
+		for(k = 0; k < nchunks && rv == ER_OK; k++)
+		{
+			save_chunk *ch = &pool.slots[k % pool.nslots];
+
+			pthread_mutex_lock(&pool.lock);
+			while(!ch->done)
+				pthread_cond_wait(&pool.formatted, &pool.lock);
+			pthread_mutex_unlock(&pool.lock);
+
+			rv = write_chunk(ch, f);
+
+			pthread_mutex_lock(&pool.lock);
+			ch->done = 0;
+			pool.next_write++;
+			pthread_cond_broadcast(&pool.written);
+			pthread_mutex_unlock(&pool.lock);
+		}
+
+		pthread_mutex_lock(&pool.lock);
+		pool.stop = 1;
+		pthread_cond_broadcast(&pool.written);
+		pthread_mutex_unlock(&pool.lock);
+		for(i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+		/* Chunks formatted after an error are never written */
+		for(i = 0; i < pool.nslots; i++)
+			free(pool.slots[i].buffer);
+	}
+
+	pthread_cond_destroy(&pool.written);
+	pthread_cond_destroy(&pool.formatted);
+	pthread_mutex_destroy(&pool.lock);
+	free(pool.slots);
+	free(threads);
+	return started ? rv : 0;
+}
+#endif
+
+/* Returns the number of processors, for nthreads <= 0 in csv_save_ex() */
+static int cpu_count(void)
+{
+#if CSV_THREADS && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if(n > 0) return (int)n;
+#endif
 	return 1;
 }
 
+/* Saves a CSV file to disk */
+int csv_save(csv_file *csv, const char *filename)
+{
+	return csv_save_ex(csv, filename, 1, 0);
+}
+
+/* Saves a CSV file to disk, formatting rows on several threads */
+int csv_save_ex(csv_file *csv, const char *filename, int nthreads, int flags)
+{
+	int k, nchunks, rv = 0;
+	FILE *f;
+
+	if(!csv || !filename) return ER_INV_PARAM;
+
+	nchunks = (csv->nrows + CSV_SAVE_ROWS - 1) / CSV_SAVE_ROWS;
+	if(nthreads <= 0)
+		nthreads = cpu_count();
+	nthreads = MY_MIN(nthreads, nchunks);
+
+	f = fopen(filename, "w");
+	if(!f)
+		return ER_IOW_FAIL;
+
+#if CSV_THREADS
+	if(nthreads > 1)
+		rv = save_threaded(csv, f, nchunks, nthreads);
+#endif
+	if(!rv)
+	{
+		/* Single-threaded, or no thread could be started */
+		save_chunk ch;
+		rv = ER_OK;
+		for(k = 0; k < nchunks && rv == ER_OK; k++)
+		{
+			format_nth_chunk(&ch, csv, k);
+			rv = write_chunk(&ch, f);
+		}
+	}
+
+	if(fflush(f))
+		rv = ER_IOW_FAIL;
+	if(rv == ER_OK && (flags & CSV_SAVE_SYNC))
+	{
+#ifdef CSV_POSIX
+		if(fsync(fileno(f)))
+			rv = ER_IOW_FAIL;
+#elif defined(_WIN32)
+		if(_commit(_fileno(f)))
+			rv = ER_IOW_FAIL;
+#endif
+	}
+	if(fclose(f) && rv == ER_OK)
+		rv = ER_IOW_FAIL;
+	if(rv != ER_OK)
+		remove(filename);
+	return rv;
+}
+
 /* Returns the number of rows in a CSV file */
 int csv_rowcount(csv_file *csv)
 {
@@ -425,3 +742,452 @@ int csv_setx(csv_file *csv, int row, int col, const char *fmt, ...)
 	
 	return csv_set(csv, row, col, buffer);
 }
+
+/* Columnar snapshots
+ *
+ * The file starts with a `col_header`, followed by a `col_desc` for each
+ * column. The rest of the file contains the columns' names, strings,
+ * values and bitmaps of empty cells at the offsets given in the `col_desc`s.
+ * All offsets are from the start of the file, and the arrays are aligned
+ * to 8 bytes so that they can be used directly from a mapped file.
+ */
+
+#define COL_MAGIC	"CSVCOL1"
+
+/* Dictionary-encoded strings; reported as CSV_COL_STRING */
+#define COL_DICT	3
+
+typedef struct col_header
+{
+	char magic[8];
+	uint64_t nrows, ncols, size;
+} col_header;
+
+typedef struct col_desc
+{
+	uint64_t type;
+	uint64_t name;		/* offset of the name, or 0 */
+	uint64_t nulls;		/* offset of the bitmap of empty cells */
+	uint64_t data;		/* int64s, doubles, string offsets or dictionary codes */
+	uint64_t dict, ndict;	/* string offsets of the dictionary */
+	double min, max;	/* range of numeric columns */
+} col_desc;
+
+struct csv_columnar
+{
+	my_filebuf fb;
+	const col_header *h;
+	const col_desc *cols;
+};
+
+/* Dictionary used while saving a string column. The table is shared by
+ * all the columns; an entry only belongs to the current column if its
+ * `column` is the current column + 1, so it never needs to be cleared */
+typedef struct col_dict_entry
+{
+	const char *s;
+	uint32_t code, column;
+} col_dict_entry;
+
+/* Writes the columnar file, keeping track of the offset itself so that
+ * it isn't limited by the `long` of `ftell()` */
+typedef struct col_writer
+{
+	FILE *f;
+	uint64_t pos;
+} col_writer;
+
+static int cell_is_int(const char *s, long long *v)
+{
+	char buf[32], *end;
+	errno = 0;
+	*v = strtoll(s, &end, 10);
+	if(end == s || *end || errno)
+		return 0;
+	sprintf(buf, "%lld", *v);
+	return !strcmp(buf, s);
+}
+
+static int cell_is_double(const char *s, double *d)
+{
+	char buf[40], *end;
+	*d = strtod(s, &end);
+	if(end == s || *end || !isfinite(*d))
+		return 0;
+	sprintf(buf, "%.15g", *d);
+	return !strcmp(buf, s);
+}
+
+/* Writes `n` bytes and returns the offset they were written at */
+static uint64_t col_write(col_writer *w, const void *data, size_t n)
+{
+	uint64_t pos = w->pos;
+	fwrite(data, 1, n, w->f);
+	w->pos += n;
+	return pos;
+}
+
+/* Pads the file to a multiple of 8 bytes and returns the offset */
+static uint64_t col_align(col_writer *w)
+{
+	while(w->pos % 8)
+	{
+		fputc(0, w->f);
+		w->pos++;
+	}
+	return w->pos;
+}
+
+static uint64_t col_write_str(col_writer *w, const char *s)
+{
+	return col_write(w, s, strlen(s) + 1);
+}
+
+/* Builds the dictionary of a string column, if it has few enough distinct
+ * values. Returns the number of distinct values (including the empty string
+ * as code 0), or 0 if the column should not be dictionary-encoded */
+static uint32_t col_build_dict(csv_file *csv, int first, int nrows, int c, col_dict_entry *table, unsigned int mask, const char **distinct, uint32_t *codes)
+{
+	uint32_t n = 1, limit = nrows / 2, column = (uint32_t)c + 1;
+	int r;
+	distinct[0] = "";
+	for(r = 0; r < nrows; r++)
+	{
+		const char *s = csv_get(csv, first + r, c);
+		unsigned int h;
+		if(!*s)
+		{
+			codes[r] = 0;
+			continue;
+		}
+		for(h = my_hash(s, strlen(s)) & mask; table[h].column == column; h = (h + 1) & mask)
+			if(!strcmp(table[h].s, s))
+				break;
+		if(table[h].column != column)
+		{
+			if(n > limit)
+				return 0;
+			table[h].s = s;
+			table[h].code = n;
+			table[h].column = column;
+			distinct[n++] = s;
+		}
+		codes[r] = table[h].code;
+	}
+	return n;
+}
+
+int csv_save_columnar(csv_file *csv, const char *filename, int flags)
+{
+	col_header h;
+	col_desc *cols = NULL;
+	uint64_t *bits = NULL, *offs = NULL;
+	uint32_t *codes = NULL;
+	col_dict_entry *table = NULL;
+	const char **distinct = NULL;
+	unsigned int tsize = 1;
+	int first, nrows, ncols = 0, r, c, rv = ER_MEM_FAIL;
+	size_t nwords;
+	col_writer w;
+
+	if(!csv || !filename) return ER_INV_PARAM;
+
+	first = (flags & CSV_COLUMNAR_HEADER) && csv->nrows > 0;
+	nrows = csv->nrows - first;
+	for(r = 0; r < csv->nrows; r++)
+		ncols = MY_MAX(ncols, csv->rows[r].ncols);
+	nwords = (nrows + 63) / 64;
+	/* Room for the most distinct values a dictionary can have, at
+	 * most half full */
+	while(tsize < (unsigned int)nrows / 2 + 2)
+		tsize <<= 1;
+	tsize <<= 1;
+
+	cols = calloc(ncols + 1, sizeof *cols);
+	bits = malloc((nwords + 1) * sizeof *bits);
+	offs = malloc((nrows + 1) * sizeof *offs);
+	codes = malloc((nrows + 1) * sizeof *codes);
+	table = calloc(tsize, sizeof *table);
+	distinct = malloc((nrows / 2 + 2) * sizeof *distinct);
+	if(!cols || !bits || !offs || !codes || !table || !distinct)
+		goto end;
+
+	rv = ER_IOW_FAIL;
+	w.f = fopen(filename, "wb");
+	w.pos = 0;
+	if(!w.f) goto end;
+
+	/* The header and descriptors are written once the offsets are known */
+	memset(&h, 0, sizeof h);
+	col_write(&w, &h, sizeof h);
+	col_write(&w, cols, ncols * sizeof *cols);
+
+	for(c = 0; c < ncols; c++)
+	{
+		col_desc *d = &cols[c];
+		int is_int = 1, is_double = 1, any = 0;
+		uint32_t ndict = 0;
+
+		if(first)
+			d->name = col_write_str(&w, csv_get(csv, 0, c));
+
+		/* Work out the type and range of the column */
+		memset(bits, 0, (nwords + 1) * sizeof *bits);
+		for(r = 0; r < nrows; r++)
+		{
+			const char *s = csv_get(csv, first + r, c);
+			long long v;
+			double x;
+			if(!*s)
+			{
+				bits[r / 64] |= (uint64_t)1 << (r % 64);
+				continue;
+			}
+			if(is_int && !cell_is_int(s, &v))
+				is_int = 0;
+			if(is_double && !cell_is_double(s, &x))
+				is_double = 0;
+			if(is_int || is_double)
+			{
+				x = is_int ? (double)v : x;
+				if(!any || x < d->min) d->min = x;
+				if(!any || x > d->max) d->max = x;
+			}
+			any = 1;
+		}
+		if(!any)
+			is_int = is_double = 0;
+
+		if(is_int || is_double)
+		{
+			d->type = is_int ? CSV_COL_INT : CSV_COL_DOUBLE;
+			d->data = col_align(&w);
+			for(r = 0; r < nrows; r++)
+			{
+				const char *s = csv_get(csv, first + r, c);
+				if(is_int)
+				{
+					int64_t v = *s ? (int64_t)strtoll(s, NULL, 10) : 0;
+					col_write(&w, &v, sizeof v);
+				}
+				else
+				{
+					double v = *s ? strtod(s, NULL) : 0.0;
+					col_write(&w, &v, sizeof v);
+				}
+			}
+		}
+		else
+		{
+			d->min = d->max = 0.0;
+			if(nrows > 0)
+				ndict = col_build_dict(csv, first, nrows, c, table, tsize - 1, distinct, codes);
+			if(ndict)
+			{
+				uint32_t i;
+				d->type = COL_DICT;
+				d->ndict = ndict;
+				for(i = 0; i < ndict; i++)
+					offs[i] = col_write_str(&w, distinct[i]);
+				d->dict = col_align(&w);
+				col_write(&w, offs, ndict * sizeof *offs);
+				d->data = col_align(&w);
+				col_write(&w, codes, nrows * sizeof *codes);
+			}
+			else
+			{
+				uint64_t empty = col_write_str(&w, "");
+				d->type = CSV_COL_STRING;
+				for(r = 0; r < nrows; r++)
+				{
+					const char *s = csv_get(csv, first + r, c);
+					offs[r] = *s ? col_write_str(&w, s) : empty;
+				}
+				d->data = col_align(&w);
+				col_write(&w, offs, nrows * sizeof *offs);
+			}
+		}
+
+		d->nulls = col_align(&w);
+		col_write(&w, bits, nwords * sizeof *bits);
+	}
+
+	memcpy(h.magic, COL_MAGIC, sizeof h.magic);
+	h.nrows = nrows;
+	h.ncols = ncols;
+	h.size = col_align(&w);
+	if(!fseek(w.f, 0, SEEK_SET))
+	{
+		fwrite(&h, sizeof h, 1, w.f);
+		fwrite(cols, sizeof *cols, ncols, w.f);
+	}
+	rv = ferror(w.f) ? ER_IOW_FAIL : ER_OK;
+	if(fclose(w.f))
+		rv = ER_IOW_FAIL;
+	if(rv != ER_OK)
+		remove(filename);
+
+end:
+	free(cols);
+	free(bits);
+	free(offs);
+	free(codes);
+	free(table);
+	free(distinct);
+	return rv;
+}
+
+csv_columnar *csv_open_columnar(const char *filename, int *err)
+{
+	csv_columnar *cc;
+	uint64_t c, len;
+
+	if(err) *err = ER_OK;
+	if(!filename)
+		RETERR(ER_INV_PARAM);
+
+	cc = malloc(sizeof *cc);
+	if(!cc)
+		RETERR(ER_MEM_FAIL);
+	if(!my_loadfile(filename, &cc->fb, 0))
+	{
+		free(cc);
+		RETERR(ER_IOR_FAIL);
+	}
+
+	/* Check that everything is inside the file; nothing else is parsed */
+	len = cc->fb.len;
+	cc->h = (const col_header *)cc->fb.data;
+	cc->cols = (const col_desc *)(cc->h + 1);
+	if(len < sizeof *cc->h || memcmp(cc->h->magic, COL_MAGIC, sizeof cc->h->magic)
+		|| cc->h->size != len || cc->h->ncols > (len - sizeof *cc->h) / sizeof *cc->cols
+		|| cc->h->nrows > len)
+		goto error;
+	for(c = 0; c < cc->h->ncols; c++)
+	{
+		const col_desc *d = &cc->cols[c];
+		uint64_t width = d->type == COL_DICT ? 4 : 8;
+		if(d->type > COL_DICT || d->name >= len || d->data % 8 || d->nulls % 8
+			|| d->data > len || cc->h->nrows * width > len - d->data
+			|| d->nulls > len || (cc->h->nrows + 63) / 64 * 8 > len - d->nulls)
+			goto error;
+		if(d->type == COL_DICT && (d->dict % 8 || d->dict > len
+			|| d->ndict > (len - d->dict) / 8 || !d->ndict))
+			goto error;
+	}
+	return cc;
+
+error:
+	if(err) *err = ER_BAD_FORMAT;
+	my_freefile(&cc->fb);
+	free(cc);
+	return NULL;
+}
+
+void csv_close_columnar(csv_columnar *cc)
+{
+	if(!cc) return;
+	my_freefile(&cc->fb);
+	free(cc);
+}
+
+/* Returns the string at `offset`, or "" if the offset is outside the
+ * file. The string is always terminated inside the mapping, since
+ * `my_loadfile()` puts a '\0' after the last byte of the file */
+static const char *col_string(csv_columnar *cc, uint64_t offset)
+{
+	if(offset >= cc->fb.len)
+		return "";
+	return cc->fb.data + offset;
+}
+
+int csv_columnar_rows(csv_columnar *cc)
+{
+	return (int)cc->h->nrows;
+}
+
+int csv_columnar_cols(csv_columnar *cc)
+{
+	return (int)cc->h->ncols;
+}
+
+const char *csv_columnar_name(csv_columnar *cc, int col)
+{
+	if(col < 0 || col >= (int)cc->h->ncols || !cc->cols[col].name)
+		return NULL;
+	return col_string(cc, cc->cols[col].name);
+}
+
+int csv_columnar_type(csv_columnar *cc, int col)
+{
+	if(col < 0 || col >= (int)cc->h->ncols)
+		return -1;
+	return cc->cols[col].type == COL_DICT ? CSV_COL_STRING : (int)cc->cols[col].type;
+}
+
+/* Returns the descriptor of a column if [row,col] is valid */
+static const col_desc *col_cell(csv_columnar *cc, int row, int col)
+{
+	if(row < 0 || col < 0 || row >= (int)cc->h->nrows || col >= (int)cc->h->ncols)
+		return NULL;
+	return &cc->cols[col];
+}
+
+int csv_columnar_empty(csv_columnar *cc, int row, int col)
+{
+	const col_desc *d = col_cell(cc, row, col);
+	const uint64_t *bits;
+	if(!d) return 1;
+	bits = (const uint64_t *)(cc->fb.data + d->nulls);
+	return (bits[row / 64] >> (row % 64)) & 1;
+}
+
+long long csv_columnar_int(csv_columnar *cc, int row, int col)
+{
+	const col_desc *d = col_cell(cc, row, col);
+	if(!d) return 0;
+	if(d->type == CSV_COL_INT)
+		return ((const int64_t *)(cc->fb.data + d->data))[row];
+	if(d->type == CSV_COL_DOUBLE)
+		return (long long)((const double *)(cc->fb.data + d->data))[row];
+	return 0;
+}
+
+double csv_columnar_double(csv_columnar *cc, int row, int col)
+{
+	const col_desc *d = col_cell(cc, row, col);
+	if(!d) return 0.0;
+	if(d->type == CSV_COL_INT)
+		return (double)((const int64_t *)(cc->fb.data + d->data))[row];
+	if(d->type == CSV_COL_DOUBLE)
+		return ((const double *)(cc->fb.data + d->data))[row];
+	return 0.0;
+}
+
+const char *csv_columnar_string(csv_columnar *cc, int row, int col)
+{
+	const col_desc *d = col_cell(cc, row, col);
+	if(!d) return "";
+	if(d->type == CSV_COL_STRING)
+		return col_string(cc, ((const uint64_t *)(cc->fb.data + d->data))[row]);
+	if(d->type == COL_DICT)
+	{
+		uint32_t code = ((const uint32_t *)(cc->fb.data + d->data))[row];
+		if(code >= d->ndict) return "";
+		return col_string(cc, ((const uint64_t *)(cc->fb.data + d->dict))[code]);
+	}
+	return NULL;
+}
+
+int csv_columnar_range(csv_columnar *cc, int col, double *min, double *max)
+{
+	const col_desc *d;
+	if(col < 0 || col >= (int)cc->h->ncols)
+		return 0;
+	d = &cc->cols[col];
+	if(d->type != CSV_COL_INT && d->type != CSV_COL_DOUBLE)
+		return 0;
+	if(min) *min = d->min;
+	if(max) *max = d->max;
+	return 1;
+}
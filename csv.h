@@ -145,10 +145,39 @@ void csv_free(csv_file *csv);
  * #### `int csv_save(csv_file *csv, const char *filename)`
  * Saves the `csv_file` file to a file named in `filename` on the disk.
  *
+ * It is the same as `csv_save_ex(csv, filename, 1, 0)`; it does not start
+ * any threads.
+ *
  * It returns 1 on success and an error code on failure (see `csv_errstr()`).
  */
 int csv_save(csv_file *csv, const char *filename);
 
+/**
+ * #### `#define CSV_SAVE_SYNC`
+ * Flag for `csv_save_ex()` to `fsync()` the file before closing it.
+ */
+#define CSV_SAVE_SYNC	0x01
+
+/**
+ * #### `int csv_save_ex(csv_file *csv, const char *filename, int nthreads, int flags)`
+ * Saves the `csv_file` file to a file named in `filename` on the disk, using
+ * up to `nthreads` threads to format the rows.
+ *
+ * The rows are formatted in blocks of `CSV_SAVE_ROWS` rows (see `csv.c`).
+ * If `nthreads` is more than 1, a pool of `nthreads` threads formats the
+ * blocks while the calling thread writes them to the file in order. If
+ * `nthreads` is 0 or less, the number of processors is used.
+ *
+ * Threads are only available on POSIX systems, where programs need to be
+ * linked with `-lpthread`, unless `csv.c` is compiled with `-DCSV_THREADS=0`.
+ *
+ * `flags` may be 0 or `CSV_SAVE_SYNC`.
+ *
+ * It returns 1 on success and an error code on failure (see `csv_errstr()`),
+ * in which case the incomplete file is removed.
+ */
+int csv_save_ex(csv_file *csv, const char *filename, int nthreads, int flags);
+
 /**
  * #### `int csv_rowcount(csv_file *csv)`
  * Retruns the number of rows in the `csv_file`.
@@ -187,6 +216,133 @@ int csv_set(csv_file *csv, int row, int col, const char *value);
  */
 int csv_setx(csv_file *csv, int row, int col, const char *fmt, ...);
 
+/**
+ * ### Columnar snapshots
+ *
+ * A `csv_file` can be saved to a binary columnar file that can later be
+ * memory-mapped with `csv_open_columnar()` and read without any parsing,
+ * which is much faster than `csv_load()` for large files that are read
+ * many times.
+ *
+ * Each column is stored with a type:
+ *
+ * - `CSV_COL_INT` if every non-empty cell is an integer,
+ * - `CSV_COL_DOUBLE` if every non-empty cell is a number, or
+ * - `CSV_COL_STRING` otherwise.
+ *
+ * A number is only converted if it prints back to exactly the same text, so
+ * that `"007"` or `"1.50"` stay strings. String columns where at most half
+ * of the values are distinct are dictionary-encoded. Numeric columns store
+ * their minimum and maximum value so that they can be skipped by queries
+ * without reading them. Empty cells, including the missing cells of short
+ * rows, are recorded in a bitmap.
+ *
+ * The file uses the byte order of the machine that wrote it.
+ */
+
+#define CSV_COL_STRING	0
+#define CSV_COL_INT		1
+#define CSV_COL_DOUBLE	2
+
+/**
+ * #### `#define CSV_COLUMNAR_HEADER`
+ * Flag for `csv_save_columnar()` to use the first row of the `csv_file` as
+ * the column names instead of as data.
+ */
+#define CSV_COLUMNAR_HEADER	0x01
+
+/**
+ * #### `typedef struct csv_columnar csv_columnar`
+ * Opaque handle to a columnar file opened with `csv_open_columnar()`.
+ */
+typedef struct csv_columnar csv_columnar;
+
+/**
+ * #### `int csv_save_columnar(csv_file *csv, const char *filename, int flags)`
+ * Saves `csv` to the columnar file `filename`.
+ *
+ * `flags` may be 0 or `CSV_COLUMNAR_HEADER`.
+ *
+ * It returns 1 on success and an error code on failure (see `csv_errstr()`).
+ */
+int csv_save_columnar(csv_file *csv, const char *filename, int flags);
+
+/**
+ * #### `csv_columnar *csv_open_columnar(const char *filename, int *err)`
+ * Maps the columnar file `filename` into memory.
+ *
+ * Only the header and column descriptors are checked here; the values are
+ * read directly from the mapping. Strings whose offsets point outside the
+ * file (in a corrupt file) are read as `""`.
+ *
+ * It returns `NULL` on failure, in which case `err` will contain the error code
+ * (`err` may be `NULL`).
+ */
+csv_columnar *csv_open_columnar(const char *filename, int *err);
+
+/**
+ * #### `void csv_close_columnar(csv_columnar *cc)`
+ * Unmaps a file opened with `csv_open_columnar()`.
+ */
+void csv_close_columnar(csv_columnar *cc);
+
+/**
+ * #### `int csv_columnar_rows(csv_columnar *cc)`
+ * #### `int csv_columnar_cols(csv_columnar *cc)`
+ * Return the number of rows and columns in `cc`.
+ */
+int csv_columnar_rows(csv_columnar *cc);
+int csv_columnar_cols(csv_columnar *cc);
+
+/**
+ * #### `const char *csv_columnar_name(csv_columnar *cc, int col)`
+ * Returns the name of column `col`, or `NULL` if the file was saved without
+ * `CSV_COLUMNAR_HEADER`.
+ */
+const char *csv_columnar_name(csv_columnar *cc, int col);
+
+/**
+ * #### `int csv_columnar_type(csv_columnar *cc, int col)`
+ * Returns the type of column `col`: `CSV_COL_STRING`, `CSV_COL_INT` or
+ * `CSV_COL_DOUBLE`, or -1 if `col` is invalid.
+ */
+int csv_columnar_type(csv_columnar *cc, int col);
+
+/**
+ * #### `int csv_columnar_empty(csv_columnar *cc, int row, int col)`
+ * Returns non-zero if the cell at [`row`,`col`] was empty or does not exist.
+ */
+int csv_columnar_empty(csv_columnar *cc, int row, int col);
+
+/**
+ * #### `long long csv_columnar_int(csv_columnar *cc, int row, int col)`
+ * #### `double csv_columnar_double(csv_columnar *cc, int row, int col)`
+ * Return the value at cell [`row`,`col`] of a numeric column.
+ *
+ * They return 0 for empty cells, string columns and invalid cells.
+ */
+long long csv_columnar_int(csv_columnar *cc, int row, int col);
+double csv_columnar_double(csv_columnar *cc, int row, int col);
+
+/**
+ * #### `const char *csv_columnar_string(csv_columnar *cc, int row, int col)`
+ * Returns the value at cell [`row`,`col`] of a string column.
+ *
+ * It returns `NULL` for numeric columns, and `""` for empty or invalid cells.
+ * The string points into the mapped file and is valid until
+ * `csv_close_columnar()`.
+ */
+const char *csv_columnar_string(csv_columnar *cc, int row, int col);
+
+/**
+ * #### `int csv_columnar_range(csv_columnar *cc, int col, double *min, double *max)`
+ * Retrieves the minimum and maximum values of numeric column `col`.
+ *
+ * It returns 0 if `col` is not a numeric column, in which case `min` and `max`
+ * are not changed.
+ */
+int csv_columnar_range(csv_columnar *cc, int col, double *min, double *max);
+
 /**
  * #### `const char *csv_errstr(int err)`
  * Returns a textual description of the error code `err`
@@ -0,0 +1,496 @@
+/*
+ * External merge sort for CSV files.
+ * See csvsort.h for details.
+ *
+ * This is free and unencumbered software released into the public domain.
+ * http://unlicense.org/
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#  define CSV_SORT_POSIX 1
+#  include <unistd.h>
+#  include <pthread.h>
+#endif
+
+#include "csvsort.h"
+
+/* This file's own configuration of the CSV reader: records are kept exactly
+as they are, and may be long. */
+#define CSV_STATIC
+#define CSV_IMPLEMENTATION
+#define CSV_BUFFER_SIZE         65536
+#define CSV_READ_BUFFER_SIZE    8192
+#define CSV_MAX_FIELDS          256
+#define CSV_TRIM                0
+#include "csvstrm.h"
+
+/* The default size of the buffer for the records */
+#ifndef CSV_SORT_MEMORY
+#  define CSV_SORT_MEMORY       (64UL << 20)
+#endif
+
+/* The buffer has to be large enough for the longest records */
+#define CSV_SORT_MIN_MEMORY     (1UL << 20)
+
+/* The number of runs merged at a time; more runs are
+merged in several passes so that fewer files are open */
+#ifndef CSV_SORT_MAX_RUNS
+#  define CSV_SORT_MAX_RUNS     64
+#endif
+
+/* Below this size subarrays are sorted by insertion */
+#define INSERTION_SORT          16
+
+#define ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/* A record in the buffer; the field pointers and text follow it */
+typedef struct Record {
+    int nf;
+    char **fields;
+} Record;
+
+typedef struct Sorter {
+    const CsvSortKey *keys;
+    int nkeys;
+} Sorter;
+
+/* The part of a run that is sorted by a thread */
+typedef struct SortJob {
+    const Sorter *s;
+    Record **a, **tmp;
+    size_t n;
+} SortJob;
+
+/* The open runs during a merge */
+typedef struct Merge {
+    const Sorter *s;
+    CsvContext **ctx;
+    int *heap, n;
+} Merge;
+
+const char *csv_sort_errstr(int err) {
+    switch(err) {
+        case CSV_SORT_OK: return "Success";
+        case CSV_SORT_ERR_MEM: return "Out of memory";
+        case CSV_SORT_ERR_IO: return "Unable to read or write a file";
+        case CSV_SORT_ERR_PARSE: return "Invalid CSV record";
+        case CSV_SORT_ERR_PARAM: return "Invalid parameter";
+    }
+    return "Unknown";
+}
+
+static int compare_numbers(const char *a, const char *b) {
+    char *ea, *eb;
+    double x = strtod(a, &ea), y = strtod(b, &eb);
+    int na = ea != a && !*ea, nb = eb != b && !*eb;
+    if(na != nb)
+        return na - nb;
+    if(!na)
+        return strcmp(a, b);
+    return (x > y) - (x < y);
+}
+
+static int compare_fields(const Sorter *s, char **a, int na, char **b, int nb) {
+    int i, r;
+    if(!s->nkeys) {
+        for(i = 0; i < na && i < nb; i++)
+            if((r = strcmp(a[i], b[i])) != 0)
+                return r;
+        return (na > nb) - (na < nb);
+    }
+    for(i = 0; i < s->nkeys; i++) {
+        int col = s->keys[i].column;
+        const char *x = col < na ? a[col] : "", *y = col < nb ? b[col] : "";
+        if(s->keys[i].flags & CSV_SORT_NUMERIC)
+            r = compare_numbers(x, y);
+        else
+            r = strcmp(x, y);
+        if(r)
+            return (s->keys[i].flags & CSV_SORT_REVERSE) ? -r : r;
+    }
+    return 0;
+}
+
+#define compare_records(s, x, y) compare_fields(s, (x)->fields, (x)->nf, (y)->fields, (y)->nf)
+
+/* Stable merge sort of `a`, using `tmp` as scratch space */
+static void sort_records(const Sorter *s, Record **a, Record **tmp, size_t n) {
+    size_t i, j, k, m;
+    if(n <= INSERTION_SORT) {
+        for(i = 1; i < n; i++) {
+            Record *r = a[i];
+            for(j = i; j > 0 && compare_records(s, a[j - 1], r) > 0; j--)
+                a[j] = a[j - 1];
+            a[j] = r;
+        }
+        return;
+    }
+    m = n / 2;
+    sort_records(s, a, tmp, m);
+    sort_records(s, a + m, tmp + m, n - m);
+    if(compare_records(s, a[m - 1], a[m]) <= 0)
+        return;
+    memcpy(tmp, a, n * sizeof *a);
+    for(i = 0, j = m, k = 0; i < m && j < n; )
+        a[k++] = compare_records(s, tmp[j], tmp[i]) < 0 ? tmp[j++] : tmp[i++];
+    while(i < m)
+        a[k++] = tmp[i++];
+    while(j < n)
+        a[k++] = tmp[j++];
+}
+
+static void *sort_job(void *arg) {
+    SortJob *job = arg;
+    sort_records(job->s, job->a, job->tmp, job->n);
+    return job;
+}
+
+static int cpu_count(void) {
+#if defined(CSV_SORT_POSIX) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n > 0)
+        return (int)n;
+#endif
+    return 1;
+}
+
+/* Sorts `a` by splitting it into parts that are sorted on their own
+threads, and then merging the parts */
+static int sort_run(const Sorter *s, Record **a, Record **tmp, size_t n, int threads) {
+    SortJob *jobs;
+    size_t *bounds, i, j, k;
+    int t, w;
+#ifdef CSV_SORT_POSIX
+    pthread_t *tids;
+    int *started;
+#endif
+
+    if(threads > 1 && n / threads < 1024)
+        threads = (int)(n / 1024);
+    if(threads < 2) {
+        sort_records(s, a, tmp, n);
+        return CSV_SORT_OK;
+    }
+
+    jobs = calloc(threads, sizeof *jobs);
+    bounds = calloc(threads + 1, sizeof *bounds);
+#ifdef CSV_SORT_POSIX
+    tids = calloc(threads, sizeof *tids);
+    started = calloc(threads, sizeof *started);
+    if(!jobs || !bounds || !tids || !started) {
+        free(tids);
+        free(started);
+#else
+    if(!jobs || !bounds) {
+#endif
+        free(jobs);
+        free(bounds);
+        return CSV_SORT_ERR_MEM;
+    }
+
+    for(t = 0; t <= threads; t++)
+        bounds[t] = n * t / threads;
+    for(t = 0; t < threads; t++) {
+        jobs[t].s = s;
+        jobs[t].a = a + bounds[t];
+        jobs[t].tmp = tmp + bounds[t];
+        jobs[t].n = bounds[t + 1] - bounds[t];
+#ifdef CSV_SORT_POSIX
+        if(!pthread_create(&tids[t], NULL, sort_job, &jobs[t])) {
+            started[t] = 1;
+            continue;
+        }
+#endif
+        sort_job(&jobs[t]);
+    }
+#ifdef CSV_SORT_POSIX
+    for(t = 0; t < threads; t++)
+        if(started[t])
+            pthread_join(tids[t], NULL);
+    free(tids);
+    free(started);
+#endif
+
+    /* Merge neighbouring parts until one is left */
+    for(w = 1; w < threads; w <<= 1) {
+        for(t = 0; t + w < threads; t += 2 * w) {
+            size_t lo = bounds[t], mid = bounds[t + w];
+            size_t hi = bounds[t + 2 * w < threads ? t + 2 * w : threads];
+            memcpy(tmp + lo, a + lo, (hi - lo) * sizeof *a);
+            for(i = lo, j = mid, k = lo; i < mid && j < hi; )
+                a[k++] = compare_records(s, tmp[j], tmp[i]) < 0 ? tmp[j++] : tmp[i++];
+            while(i < mid)
+                a[k++] = tmp[i++];
+            while(j < hi)
+                a[k++] = tmp[j++];
+        }
+    }
+
+    free(jobs);
+    free(bounds);
+    return CSV_SORT_OK;
+}
+
+static int write_run(FILE *f, Record **a, size_t n) {
+    size_t i;
+    for(i = 0; i < n; i++)
+        if(!csv_write_record(f, (const char *const *)a[i]->fields, a[i]->nf))
+            return CSV_SORT_ERR_IO;
+    return fflush(f) ? CSV_SORT_ERR_IO : CSV_SORT_OK;
+}
+
+/* Reads the next record of run `i` of a merge; returns 0 at the end */
+static int next_record(Merge *m, int i, int *rv) {
+    CsvContext *ctx = m->ctx[i];
+    while(csv_read_record(ctx)) {
+        if(csv_get_error(ctx) != CSV_OK) {
+            *rv = CSV_SORT_ERR_PARSE;
+            return 0;
+        }
+        if(csv_count(ctx) > 1 || csv_field(ctx, 0)[0])
+            return 1;
+    }
+    return 0;
+}
+
+/* Is the current record of run `i` smaller than that of run `j`?
+Equal records are taken from the earlier run to keep the sort stable */
+static int heap_less(Merge *m, int i, int j) {
+    int r = compare_fields(m->s, m->ctx[i]->fields, m->ctx[i]->nf, m->ctx[j]->fields, m->ctx[j]->nf);
+    return r < 0 || (!r && i < j);
+}
+
+static void heap_down(Merge *m, int k) {
+    for(;;) {
+        int c = 2 * k + 1, t;
+        if(c >= m->n)
+            break;
+        if(c + 1 < m->n && heap_less(m, m->heap[c + 1], m->heap[c]))
+            c++;
+        if(!heap_less(m, m->heap[c], m->heap[k]))
+            break;
+        t = m->heap[c];
+        m->heap[c] = m->heap[k];
+        m->heap[k] = t;
+        k = c;
+    }
+}
+
+/* Merges the `n` runs in `runs` into `out` */
+static int merge_runs(const Sorter *s, FILE **runs, int n, FILE *out) {
+    Merge m;
+    int i, rv = CSV_SORT_OK;
+
+    m.s = s;
+    m.n = 0;
+    m.ctx = calloc(n, sizeof *m.ctx);
+    m.heap = calloc(n, sizeof *m.heap);
+    if(!m.ctx || !m.heap) {
+        rv = CSV_SORT_ERR_MEM;
+        goto end;
+    }
+    for(i = 0; i < n; i++) {
+        if(!(m.ctx[i] = malloc(sizeof *m.ctx[i]))) {
+            rv = CSV_SORT_ERR_MEM;
+            goto end;
+        }
+        rewind(runs[i]);
+        csv_context_file(m.ctx[i], runs[i]);
+        if(next_record(&m, i, &rv))
+            m.heap[m.n++] = i;
+        else if(rv != CSV_SORT_OK)
+            goto end;
+    }
+    for(i = m.n / 2 - 1; i >= 0; i--)
+        heap_down(&m, i);
+
+    while(m.n > 0) {
+        CsvContext *ctx = m.ctx[m.heap[0]];
+        if(!csv_write_record(out, (const char *const *)ctx->fields, ctx->nf)) {
+            rv = CSV_SORT_ERR_IO;
+            goto end;
+        }
+        if(!next_record(&m, m.heap[0], &rv)) {
+            if(rv != CSV_SORT_OK)
+                goto end;
+            m.heap[0] = m.heap[--m.n];
+        }
+        heap_down(&m, 0);
+    }
+    for(i = 0; i < n; i++)
+        if(ferror(runs[i]))
+            rv = CSV_SORT_ERR_IO;
+
+end:
+    if(m.ctx)
+        for(i = 0; i < n; i++)
+            free(m.ctx[i]);
+    free(m.ctx);
+    free(m.heap);
+    return rv;
+}
+
+int csv_sort(FILE *in, FILE *out, const CsvSortOptions *opt) {
+    CsvContext *csv;
+    Sorter s;
+    size_t memory, used = 0, n = 0, i;
+    char *buffer = NULL;
+    Record **end, **a;
+    FILE **runs = NULL;
+    int nruns = 0, threads, header, rv = CSV_SORT_OK, f;
+
+    if(!in || !out)
+        return CSV_SORT_ERR_PARAM;
+
+    s.keys = opt ? opt->keys : NULL;
+    s.nkeys = opt && opt->keys ? opt->nkeys : 0;
+    for(f = 0; f < s.nkeys; f++)
+        if(s.keys[f].column < 0)
+            return CSV_SORT_ERR_PARAM;
+    header = opt && opt->header;
+    memory = opt && opt->memory ? opt->memory : CSV_SORT_MEMORY;
+    if(memory < CSV_SORT_MIN_MEMORY)
+        memory = CSV_SORT_MIN_MEMORY;
+    memory &= ~(sizeof(void *) - 1);
+    threads = opt && opt->threads > 0 ? opt->threads : cpu_count();
+
+    csv = malloc(sizeof *csv);
+    buffer = malloc(memory);
+    if(!csv || !buffer) {
+        rv = CSV_SORT_ERR_MEM;
+        goto end;
+    }
+
+    /* The records are stored from the start of the buffer, and pointers to
+    them from the end, leaving as much space again for the sort */
+    end = (Record **)(buffer + memory);
+    csv_context_file(csv, in);
+    for(;;) {
+        int more = csv_read_record(csv);
+        size_t size = 0;
+        Record *r;
+        char *p;
+
+        if(more) {
+            if(csv_get_error(csv) != CSV_OK) {
+                rv = CSV_SORT_ERR_PARSE;
+                goto end;
+            }
+            if(csv_count(csv) == 1 && !csv_field(csv, 0)[0])
+                continue;
+            if(header) {
+                header = 0;
+                if(!csv_write_record(out, (const char *const *)csv->fields, csv->nf)) {
+                    rv = CSV_SORT_ERR_IO;
+                    goto end;
+                }
+                continue;
+            }
+            size = sizeof *r + csv->nf * sizeof(char *);
+            for(f = 0; f < csv->nf; f++)
+                size += strlen(csv->fields[f]) + 1;
+            size = ALIGN(size);
+        }
+
+        if(!more || used + size + (n + 1) * 2 * sizeof(Record *) > memory) {
+            /* Sort the buffer, and spill it if there is more to come */
+            a = end - n;
+            for(i = 0; i < n / 2; i++) {
+                Record *t = a[i];
+                a[i] = a[n - 1 - i];
+                a[n - 1 - i] = t;
+            }
+            if((rv = sort_run(&s, a, a - n, n, threads)) != CSV_SORT_OK)
+                goto end;
+            if(!more && !nruns) {
+                rv = write_run(out, a, n);
+                goto end;
+            }
+            if(n) {
+                FILE **nr = realloc(runs, (nruns + 1) * sizeof *runs);
+                if(!nr) {
+                    rv = CSV_SORT_ERR_MEM;
+                    goto end;
+                }
+                runs = nr;
+                if(!(runs[nruns] = tmpfile())) {
+                    rv = CSV_SORT_ERR_IO;
+                    goto end;
+                }
+                if((rv = write_run(runs[nruns++], a, n)) != CSV_SORT_OK)
+                    goto end;
+            }
+            used = n = 0;
+            if(!more)
+                break;
+            if(size + 2 * sizeof(Record *) > memory) {
+                rv = CSV_SORT_ERR_MEM;
+                goto end;
+            }
+        }
+
+        r = (Record *)(buffer + used);
+        r->nf = csv->nf;
+        r->fields = (char **)(r + 1);
+        p = (char *)(r->fields + r->nf);
+        for(f = 0; f < csv->nf; f++) {
+            size_t len = strlen(csv->fields[f]) + 1;
+            memcpy(p, csv->fields[f], len);
+            r->fields[f] = p;
+            p += len;
+        }
+        used += size;
+        *(end - ++n) = r;
+    }
+
+    /* The buffer is no longer needed for the merge */
+    free(buffer);
+    buffer = NULL;
+
+    /* Merge the runs level by level: each pass merges groups of
+    CSV_SORT_MAX_RUNS runs into new runs, reading every record once, until
+    the remaining runs can be merged into the output. The new runs keep the
+    order of their groups, so that the sort stays stable */
+    while(nruns > CSV_SORT_MAX_RUNS) {
+        int g, k, ngroups = 0;
+        for(g = 0; g < nruns; g += CSV_SORT_MAX_RUNS) {
+            FILE *merged = runs[g];
+            k = nruns - g < CSV_SORT_MAX_RUNS ? nruns - g : CSV_SORT_MAX_RUNS;
+            if(k > 1) {
+                if(!(merged = tmpfile())) {
+                    rv = CSV_SORT_ERR_IO;
+                    goto end;
+                }
+                rv = merge_runs(&s, runs + g, k, merged);
+                if(rv == CSV_SORT_OK && fflush(merged))
+                    rv = CSV_SORT_ERR_IO;
+                for(f = g; f < g + k; f++) {
+                    fclose(runs[f]);
+                    runs[f] = NULL;
+                }
+                if(rv != CSV_SORT_OK) {
+                    fclose(merged);
+                    goto end;
+                }
+            }
+            runs[g] = NULL;
+            runs[ngroups++] = merged;
+        }
+        nruns = ngroups;
+    }
+    rv = merge_runs(&s, runs, nruns, out);
+
+end:
+    if(rv == CSV_SORT_OK && (ferror(in) || fflush(out)))
+        rv = CSV_SORT_ERR_IO;
+    for(f = 0; f < nruns; f++)
+        if(runs[f])
+            fclose(runs[f]);
+    free(runs);
+    free(buffer);
+    free(csv);
+    return rv;
+}
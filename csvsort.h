@@ -0,0 +1,125 @@
+/**
+ * # `csvsort.h`
+ * External merge sort for CSV files that are larger than memory.
+ *
+ * The records are read with the CSV stream reader in **csvstrm.h** into a
+ * buffer of a fixed size. Whenever the buffer is full, its records are
+ * sorted on several threads and written to a temporary file as a _run_.
+ * The runs are then merged into the output through a heap, reading each
+ * run sequentially.
+ *
+ * Quoted fields, including fields that span several lines, are parsed
+ * and written again as CSV, so the output is equivalent to the input but
+ * fields are only quoted where necessary.
+ *
+ * The sort is stable: records with equal keys keep their order from the
+ * input.
+ *
+ * ### License
+ *
+ *     Author: Werner Stoop
+ *     This is free and unencumbered software released into the public domain.
+ *     See http://unlicense.org/ for more details.
+ *
+ * ## API
+ */
+
+#ifndef CSVSORT_H
+#define CSVSORT_H
+
+#include <stdio.h>
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * ### Error codes
+ *
+ * * `CSV_SORT_OK` - Success
+ * * `CSV_SORT_ERR_MEM` - Out of memory
+ * * `CSV_SORT_ERR_IO` - Unable to read or write a file
+ * * `CSV_SORT_ERR_PARSE` - The input contains a malformed record, or a
+ *   record that is too long
+ * * `CSV_SORT_ERR_PARAM` - Invalid parameter
+ */
+#define CSV_SORT_OK          1
+#define CSV_SORT_ERR_MEM    -1
+#define CSV_SORT_ERR_IO     -2
+#define CSV_SORT_ERR_PARSE  -3
+#define CSV_SORT_ERR_PARAM  -4
+
+/**
+ * ### Key flags
+ *
+ * * `CSV_SORT_NUMERIC` - Compare the fields as numbers. Fields that are
+ *   not numbers sort before all numbers, in text order.
+ * * `CSV_SORT_REVERSE` - Sort in descending order.
+ */
+#define CSV_SORT_NUMERIC    0x01
+#define CSV_SORT_REVERSE    0x02
+
+/**
+ * ### `typedef struct CsvSortKey CsvSortKey`
+ *
+ * A column to sort on:
+ *
+ * * `int column` - The index of the column, from 0. Records that are too
+ *   short to have the column sort as if the field is empty.
+ * * `int flags` - A combination of the key flags.
+ */
+typedef struct CsvSortKey {
+    int column;
+    int flags;
+} CsvSortKey;
+
+/**
+ * ### `typedef struct CsvSortOptions CsvSortOptions`
+ *
+ * * `const CsvSortKey *keys`, `int nkeys` - The columns to sort on, in order
+ *   of priority. If `nkeys` is 0, the records are compared field by field
+ *   as text.
+ * * `int header` - If non-zero, the first record is a header that is
+ *   written to the output first.
+ * * `size_t memory` - The size of the buffer for the records, in bytes.
+ *   If it is 0, `CSV_SORT_MEMORY` (64MB) is used. Each record takes the
+ *   size of its text plus a few pointers per field, and the smallest
+ *   buffer is 1MB.
+ * * `int threads` - The number of threads to sort each run with. If it
+ *   is 0, the number of processors is used.
+ */
+typedef struct CsvSortOptions {
+    const CsvSortKey *keys;
+    int nkeys;
+    int header;
+    size_t memory;
+    int threads;
+} CsvSortOptions;
+
+/**
+ * ### `int csv_sort(FILE *in, FILE *out, const CsvSortOptions *opt)`
+ *
+ * Sorts the CSV records read from `in` and writes them to `out`.
+ *
+ * `opt` may be `NULL` to sort on all the fields, in the default memory.
+ *
+ * Blank lines are skipped. The runs are written to files created with
+ * `tmpfile()`, which are removed afterwards.
+ *
+ * It returns `CSV_SORT_OK` on success and an error code on failure (see
+ * `csv_sort_errstr()`).
+ */
+int csv_sort(FILE *in, FILE *out, const CsvSortOptions *opt);
+
+/**
+ * ### `const char *csv_sort_errstr(int err)`
+ *
+ * Returns a textual description of the error code `err`.
+ */
+const char *csv_sort_errstr(int err);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+} /* extern "C" */
+#endif
+
+#endif /* CSVSORT_H */
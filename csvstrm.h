@@ -1,4 +1,5 @@
 #ifndef CSV_STREAM_H
+#define CSV_STREAM_H
 
 #ifdef __cplusplus
 extern "C" {
@@ -103,8 +104,13 @@ extern "C" {
  *   If `CSV_TRIM` is non-zero the field will be returned as `"foo"`.  \
  *   If it is 0 then the whitespace will be left intact, so it will be
  *   returned as `" foo "`
+ * * `CSV_STATIC` -
+ *   Define this to have all the functions in the library declared
+ *   `static`, so that a C file can use its own configuration of the
+ *   library without clashing with other files that include **csvstrm.h**.
  *
- * These macros _must_ be the same in all files that include **csvstrm.h**.
+ * These macros _must_ be the same in all files that include **csvstrm.h**
+ * (unless `CSV_STATIC` is defined).
  */
 
 #  ifndef CSV_DELIMITER
@@ -127,6 +133,16 @@ extern "C" {
 #    define CSV_TRIM 1
 #  endif
 
+#ifdef CSV_STATIC
+#  ifdef __GNUC__
+#    define _CSV_EXPORT static __attribute__((unused))
+#  else
+#    define _CSV_EXPORT static
+#  endif
+#else
+#  define _CSV_EXPORT
+#endif
+
 /**
  * ## Definitions
  *
@@ -206,9 +222,15 @@ typedef struct CsvContext {
     /* The internal buffer, where bytes are read into
     from the file, but before they're processed. */
     char raw_buffer[CSV_READ_BUFFER_SIZE];
-    int in_pos;
+    int in_pos, in_len;
     int last_char;
 
+    /* Offset in the input of `raw_buffer[0]` */
+    long long block_offset;
+
+    /* Non-zero if there are no quotes in `raw_buffer` */
+    int plain;
+
     /* Where the data for the fields are stored.
     The values in `fields` are a pointers into this buffer */
     char buffer[CSV_BUFFER_SIZE];
@@ -233,7 +255,7 @@ typedef struct CsvContext {
  * Initialises a `CsvContext` structure to read data from a file
  * pointed to by `file`.
  */
-void csv_context_file(CsvContext *csv, FILE *file);
+_CSV_EXPORT void csv_context_file(CsvContext *csv, FILE *file);
 
 /**
  * ### `void csv_context_file_limit(CsvContext *csv, struct csv_read_limit *ll)`
@@ -261,7 +283,24 @@ struct csv_read_limit {
     int limit;
 };
 
-void csv_context_file_limit(CsvContext *csv, struct csv_read_limit *ll);
+_CSV_EXPORT void csv_context_file_limit(CsvContext *csv, struct csv_read_limit *ll);
+
+/**
+ * ## Writing records
+ *
+ * ### `int csv_write_record(FILE *f, const char *const fields[], int n)`
+ *
+ * Writes a record with the `n` fields in `fields` to the file `f`,
+ * separated by `CSV_DELIMITER` and terminated by a newline.
+ *
+ * Fields that contain the delimiter, quotes or line breaks (or leading or
+ * trailing whitespace, if `CSV_TRIM` is non-zero) are quoted, so that
+ * `csv_read_record()` reads them back unchanged. `NULL` fields are
+ * written as empty fields.
+ *
+ * It returns 1 on success, or 0 if there was an error writing to `f`.
+ */
+_CSV_EXPORT int csv_write_record(FILE *f, const char *const fields[], int n);
 #endif
 
 /**
@@ -270,7 +309,7 @@ void csv_context_file_limit(CsvContext *csv, struct csv_read_limit *ll);
  * Initialises a `CsvContext` with a custom function `fun` that will read bytes
  * from an object `data`.
  */
-void csv_context_custom(CsvContext *csv, csv_read_data_fun fun, void *data);
+_CSV_EXPORT void csv_context_custom(CsvContext *csv, csv_read_data_fun fun, void *data);
 
 /**
  * ## Reading records
@@ -298,22 +337,110 @@ void csv_context_custom(CsvContext *csv, csv_read_data_fun fun, void *data);
  * Retrieves an error code (if any) from the `CsvContext`.
  * The error codes are described in Subsection [enum csv_error_code](#enum-csv_error_code).
  */
-int csv_read_record(CsvContext *csv);
+_CSV_EXPORT int csv_read_record(CsvContext *csv);
+
+_CSV_EXPORT int csv_count(CsvContext *csv);
+
+_CSV_EXPORT const char *csv_field(CsvContext *csv, int i);
+
+_CSV_EXPORT enum csv_error_code csv_get_error(CsvContext *csv);
+
+/**
+ * ### `long long csv_offset(CsvContext *csv)`
+ *
+ * Returns the offset in the input of the next byte that will be
+ * processed. Between records, it is the offset of the next record.
+ */
+_CSV_EXPORT long long csv_offset(CsvContext *csv);
+
+#ifdef EOF
+/**
+ * ## Row indexes
+ *
+ * A row index is a sidecar file that stores the byte offsets of the
+ * records in a CSV file, so that a large file can be opened at any row
+ * without reading everything before it.
+ *
+ * The index stores the offset and the number of fields of every `every`th
+ * record, along with the size and modification time of the CSV file, so
+ * that a stale index is detected. The index is stored in the machine's
+ * native byte order.
+ *
+ * Offsets are 64-bit, so files larger than 2GB can be indexed. On 32-bit
+ * POSIX systems this needs `_FILE_OFFSET_BITS` to be defined as 64 when
+ * compiling; on Windows `_fseeki64()` and `_stati64()` are used.
+ *
+ * ### `int csv_build_index(const char *filename, const char *index_file, int every)`
+ *
+ * Reads the CSV file `filename` and writes the index of every `every`th
+ * record (every record if `every` is 1) to `index_file`. If `index_file`
+ * is `NULL`, `filename` with `".idx"` appended is used.
+ *
+ * It returns 1 on success, or 0 if a file could not be read or written,
+ * or if there was an error in the CSV file.
+ *
+ * ### `int csv_index_open(CsvIndex *idx, const char *filename, const char *index_file)`
+ *
+ * Opens the CSV file `filename` through its index `index_file` (which
+ * defaults to `filename` with `".idx"` appended, as above).
+ *
+ * It returns 1 on success, or 0 if a file could not be opened or if the
+ * index is invalid or doesn't match the CSV file anymore, in which case
+ * it can be rebuilt with `csv_build_index()`.
+ *
+ * Only the header of the index is read; the entries are read as needed.
+ *
+ * ### `int csv_index_seek(CsvIndex *idx, CsvContext *csv, unsigned long row)`
+ *
+ * Initialises `csv` so that the next `csv_read_record()` reads the
+ * record `row` (counting from 0) of the indexed file.
+ *
+ * It seeks to the closest indexed record before `row` and skips the
+ * rest, so it reads at most `every - 1` records.
+ *
+ * It returns 1 on success, or 0 if `row` is out of range or on error.
+ *
+ * ### `unsigned long csv_index_rows(CsvIndex *idx)`
+ *
+ * Returns the number of records in the indexed file.
+ *
+ * ### `int csv_index_fields(CsvIndex *idx, unsigned long row)`
+ *
+ * Returns the number of fields in record `row`, or -1 if the record
+ * is not one of the indexed records.
+ *
+ * ### `void csv_index_close(CsvIndex *idx)`
+ *
+ * Closes the files opened by `csv_index_open()`.
+ */
+typedef struct CsvIndex {
+    FILE *csv, *index;
+    unsigned long rows, entries, every;
+} CsvIndex;
+
+_CSV_EXPORT int csv_build_index(const char *filename, const char *index_file, int every);
 
-int csv_count(CsvContext *csv);
+_CSV_EXPORT int csv_index_open(CsvIndex *idx, const char *filename, const char *index_file);
 
-const char *csv_field(CsvContext *csv, int i);
+_CSV_EXPORT int csv_index_seek(CsvIndex *idx, CsvContext *csv, unsigned long row);
 
-enum csv_error_code csv_get_error(CsvContext *csv);
+_CSV_EXPORT unsigned long csv_index_rows(CsvIndex *idx);
+
+_CSV_EXPORT int csv_index_fields(CsvIndex *idx, unsigned long row);
+
+_CSV_EXPORT void csv_index_close(CsvIndex *idx);
+#endif
 
 /* *********************************************************************** */
 
 #  ifdef CSV_IMPLEMENTATION
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <sys/stat.h>
 
 #ifdef __cplusplus
 #  define CAST(x, y)   (x)y
@@ -330,23 +457,73 @@ static int _csv_get_char(CsvContext *csv) {
         csv->last_char = 0;
         return c;
     }
-    if(csv->in_pos >= CSV_READ_BUFFER_SIZE || (c = csv->raw_buffer[csv->in_pos++]) == '\0') {
+    while(csv->in_pos >= csv->in_len) {
         int cnt = csv->get_data(csv->raw_buffer, CSV_READ_BUFFER_SIZE - 1, csv->data);
         if(!cnt) {
             csv->last_char = EOF;
             return EOF;
         }
+        csv->block_offset += csv->in_len;
         csv->in_pos = 0;
-        c = csv->raw_buffer[csv->in_pos++];
+        csv->in_len = strlen(csv->raw_buffer);
+        csv->plain = !memchr(csv->raw_buffer, '\"', csv->in_len);
+    }
+    return csv->raw_buffer[csv->in_pos++];
+}
+
+/* Fast path for records in blocks without quotes: If the whole record is
+in the block, it is split on the delimiters directly. Returns 0 if the
+record has to go through the state machine in `csv_read_record()` */
+static int _csv_read_plain(CsvContext *csv) {
+    const char *p = csv->raw_buffer + csv->in_pos, *e, *end;
+    char *b = csv->buffer;
+    int nf = 1;
+
+    end = CAST(const char *, memchr(p, '\n', csv->in_len - csv->in_pos));
+    if(!end || end - p >= CSV_BUFFER_SIZE - CSV_MAX_FIELDS)
+        return 0;
+    e = end;
+    if(e > p && e[-1] == '\r')
+        e--;
+    if(memchr(p, '\r', e - p))
+        return 0;
+    for(; p < e; p++)
+        if(*p == CSV_DELIMITER)
+            nf++;
+    if(nf > CSV_MAX_FIELDS)
+        return 0;
+
+    p = csv->raw_buffer + csv->in_pos;
+    csv->nf = 0;
+    for(;;) {
+        const char *q = p;
+        while(q < e && *q != CSV_DELIMITER)
+            q++;
+#if CSV_TRIM
+        while(p < q && strchr(" \t\v\f", *p))
+            p++;
+        while(q > p && strchr(" \t\v\f", q[-1]))
+            q--;
+#endif
+        csv->fields[csv->nf++] = b;
+        memcpy(b, p, q - p);
+        b += q - p;
+        *b++ = '\0';
+        while(q < e && *q != CSV_DELIMITER)
+            q++;
+        if(q == e)
+            break;
+        p = q + 1;
     }
-    return c;
+    csv->in_pos = (int)(end + 1 - csv->raw_buffer);
+    return 1;
 }
 
 static void _csv_unget_char(CsvContext *csv, int c) {
     csv->last_char = c;
 }
 
-int csv_read_record(CsvContext *csv) {
+_CSV_EXPORT int csv_read_record(CsvContext *csv) {
     int c = 0;
     size_t start, bump = 0;
 
@@ -362,6 +539,9 @@ int csv_read_record(CsvContext *csv) {
     for(;;) {
         switch(state) {
             case RECORD_START:
+                if(csv->plain && !csv->last_char && csv->in_pos < csv->in_len
+                        && _csv_read_plain(csv))
+                    return csv->nf;
                 c = _csv_get_char(csv);
                 if(c == EOF)
                     return 0;
@@ -401,6 +581,8 @@ int csv_read_record(CsvContext *csv) {
 #if CSV_TRIM
                     while(bump > start && strchr(" \t\v\f", csv->buffer[bump-1]))
                         bump--;
+#else
+                    (void)start;
 #endif
                     state = c == CSV_DELIMITER ? FIELD_END : RECORD_END;
                 } else {
@@ -459,11 +641,13 @@ int csv_read_record(CsvContext *csv) {
     /*return 0;*/
 }
 
-void csv_context_custom(CsvContext *csv, csv_read_data_fun fun, void *data) {
+_CSV_EXPORT void csv_context_custom(CsvContext *csv, csv_read_data_fun fun, void *data) {
     csv->get_data = fun;
     csv->data = data;
     csv->last_char = 0;
-    csv->in_pos = CSV_READ_BUFFER_SIZE;
+    csv->in_pos = csv->in_len = 0;
+    csv->block_offset = 0;
+    csv->plain = 0;
     csv->nf = 0;
     csv->err = CSV_OK;
 }
@@ -480,7 +664,7 @@ static int _csv_file_input_get_line(char *str, int num, void *data) {
     return 1;
 }
 
-void csv_context_file(CsvContext *csv, FILE *file) {
+_CSV_EXPORT void csv_context_file(CsvContext *csv, FILE *file) {
     assert(file != NULL);
     csv_context_custom(csv, _csv_file_input_get_line, file);
 }
@@ -500,25 +684,228 @@ static int _csv_file_input_get_line_limit(char *str, int num, void *data) {
     return 1;
 }
 
-void csv_context_file_limit(CsvContext *csv, struct csv_read_limit *ll) {
+_CSV_EXPORT void csv_context_file_limit(CsvContext *csv, struct csv_read_limit *ll) {
     assert(ll->f != NULL);
     assert(ll->limit > 0);
     csv_context_custom(csv, _csv_file_input_get_line_limit, ll);
 }
 
-int csv_count(CsvContext *csv) {
+#ifdef EOF
+/* Determines whether a field needs to be quoted */
+static int _csv_needs_quotes(const char *s) {
+#if CSV_TRIM
+    if(s[0] && strchr(" \t\v\f", s[0]))
+        return 1;
+    if(s[0] && strchr(" \t\v\f", s[strlen(s) - 1]))
+        return 1;
+#endif
+    for(; *s; s++)
+        if(*s == CSV_DELIMITER || *s == '\"' || *s == '\r' || *s == '\n')
+            return 1;
+    return 0;
+}
+
+_CSV_EXPORT int csv_write_record(FILE *f, const char *const fields[], int n) {
+    int i;
+    for(i = 0; i < n; i++) {
+        const char *s = fields[i] ? fields[i] : "";
+        if(i > 0)
+            fputc(CSV_DELIMITER, f);
+        if(_csv_needs_quotes(s)) {
+            fputc('\"', f);
+            for(; *s; s++) {
+                if(*s == '\"')
+                    fputc('\"', f);
+                fputc(*s, f);
+            }
+            fputc('\"', f);
+        } else
+            fputs(s, f);
+    }
+    fputc('\n', f);
+    return !ferror(f);
+}
+#endif
+
+_CSV_EXPORT int csv_count(CsvContext *csv) {
     return csv->nf;
 }
 
-const char *csv_field(CsvContext *csv, int i) {
+_CSV_EXPORT const char *csv_field(CsvContext *csv, int i) {
     if(i < 0 || i >= csv->nf) return "";
     return csv->fields[i];
 }
 
-enum csv_error_code csv_get_error(CsvContext *csv) {
+_CSV_EXPORT enum csv_error_code csv_get_error(CsvContext *csv) {
     return csv->err;
 }
 
+_CSV_EXPORT long long csv_offset(CsvContext *csv) {
+    long long offset = csv->block_offset + csv->in_pos;
+    if(csv->last_char && csv->last_char != EOF)
+        offset--;
+    return offset;
+}
+
+/* The index file has a header of `_CSV_IDX_HEADER` 8-byte values: a
+magic number, the size and modification time of the CSV file, `every`,
+and the number of records and entries. Each entry has an 8-byte offset
+and a 4-byte field count */
+#define _CSV_IDX_MAGIC  0x31584449565343ULL
+#define _CSV_IDX_HEADER 6
+#define _CSV_IDX_ENTRY  12
+
+/* Seeking and file sizes with 64-bit offsets */
+#if defined(_WIN32)
+#  define _CSV_SEEK(f, offset)  _fseeki64(f, (__int64)(offset), SEEK_SET)
+#  define _CSV_STAT_T           struct _stati64
+#  define _CSV_STAT             _stati64
+#elif defined(__unix__) || defined(__APPLE__)
+#  define _CSV_SEEK(f, offset)  fseeko(f, (off_t)(offset), SEEK_SET)
+#  define _CSV_STAT_T           struct stat
+#  define _CSV_STAT             stat
+#else
+#  define _CSV_SEEK(f, offset)  fseek(f, (long)(offset), SEEK_SET)
+#  define _CSV_STAT_T           struct stat
+#  define _CSV_STAT             stat
+#endif
+
+/* The default name of the index of `filename` */
+static char *_csv_index_name(const char *filename) {
+    char *name = CAST(char *, malloc(strlen(filename) + 5));
+    if(name) {
+        strcpy(name, filename);
+        strcat(name, ".idx");
+    }
+    return name;
+}
+
+static int _csv_write_u64(FILE *f, unsigned long long v) {
+    return fwrite(&v, sizeof v, 1, f) == 1;
+}
+
+_CSV_EXPORT int csv_build_index(const char *filename, const char *index_file, int every) {
+    CsvContext csv;
+    _CSV_STAT_T st;
+    FILE *f = NULL, *out = NULL;
+    char *tmp = NULL;
+    const char *name = index_file;
+    unsigned long long rows = 0, entries = 0;
+    int ok = 0;
+
+    if(every < 1)
+        every = 1;
+    if(!name && !(name = tmp = _csv_index_name(filename)))
+        return 0;
+    if(_CSV_STAT(filename, &st) || !(f = fopen(filename, "rb")) || !(out = fopen(name, "wb")))
+        goto end;
+
+    /* The counts in the header are filled in at the end */
+    if(!_csv_write_u64(out, 0) || !_csv_write_u64(out, st.st_size) || !_csv_write_u64(out, st.st_mtime)
+            || !_csv_write_u64(out, every) || !_csv_write_u64(out, 0) || !_csv_write_u64(out, 0))
+        goto end;
+
+    csv_context_file(&csv, f);
+    for(;;) {
+        unsigned long long offset = csv_offset(&csv);
+        unsigned int nf = csv_read_record(&csv);
+        if(!nf)
+            break;
+        if(csv_get_error(&csv) != CSV_OK)
+            goto end;
+        if(rows++ % every == 0) {
+            if(!_csv_write_u64(out, offset) || fwrite(&nf, sizeof nf, 1, out) != 1)
+                goto end;
+            entries++;
+        }
+    }
+    if(ferror(f) || fseek(out, 0, SEEK_SET)
+            || !_csv_write_u64(out, _CSV_IDX_MAGIC) || fseek(out, 4 * 8, SEEK_SET)
+            || !_csv_write_u64(out, rows) || !_csv_write_u64(out, entries))
+        goto end;
+    ok = 1;
+
+end:
+    if(f)
+        fclose(f);
+    if(out && fclose(out))
+        ok = 0;
+    if(!ok && out)
+        remove(name);
+    free(tmp);
+    return ok;
+}
+
+_CSV_EXPORT int csv_index_open(CsvIndex *idx, const char *filename, const char *index_file) {
+    unsigned long long h[_CSV_IDX_HEADER];
+    _CSV_STAT_T st;
+    char *tmp = NULL;
+
+    idx->csv = idx->index = NULL;
+    if(!index_file && !(index_file = tmp = _csv_index_name(filename)))
+        return 0;
+    idx->index = fopen(index_file, "rb");
+    free(tmp);
+    if(!idx->index || _CSV_STAT(filename, &st)
+            || fread(h, sizeof *h, _CSV_IDX_HEADER, idx->index) != _CSV_IDX_HEADER
+            || h[0] != _CSV_IDX_MAGIC || h[1] != (unsigned long long)st.st_size
+            || h[2] != (unsigned long long)st.st_mtime || !h[3]
+            || !(idx->csv = fopen(filename, "rb"))) {
+        csv_index_close(idx);
+        return 0;
+    }
+    idx->every = (unsigned long)h[3];
+    idx->rows = (unsigned long)h[4];
+    idx->entries = (unsigned long)h[5];
+    return 1;
+}
+
+/* Reads entry `k` of the index */
+static int _csv_index_entry(CsvIndex *idx, unsigned long k, unsigned long long *offset, unsigned int *nf) {
+    if(k >= idx->entries
+            || _CSV_SEEK(idx->index, _CSV_IDX_HEADER * 8 + (unsigned long long)k * _CSV_IDX_ENTRY)
+            || fread(offset, sizeof *offset, 1, idx->index) != 1
+            || fread(nf, sizeof *nf, 1, idx->index) != 1)
+        return 0;
+    return 1;
+}
+
+_CSV_EXPORT int csv_index_seek(CsvIndex *idx, CsvContext *csv, unsigned long row) {
+    unsigned long long offset;
+    unsigned int nf;
+    unsigned long skip;
+
+    if(row >= idx->rows || !_csv_index_entry(idx, row / idx->every, &offset, &nf)
+            || _CSV_SEEK(idx->csv, offset))
+        return 0;
+    clearerr(idx->csv);
+    csv_context_file(csv, idx->csv);
+    for(skip = row % idx->every; skip > 0; skip--)
+        if(!csv_read_record(csv) || csv_get_error(csv) != CSV_OK)
+            return 0;
+    return 1;
+}
+
+_CSV_EXPORT unsigned long csv_index_rows(CsvIndex *idx) {
+    return idx->rows;
+}
+
+_CSV_EXPORT int csv_index_fields(CsvIndex *idx, unsigned long row) {
+    unsigned long long offset;
+    unsigned int nf;
+    if(row % idx->every || !_csv_index_entry(idx, row / idx->every, &offset, &nf))
+        return -1;
+    return (int)nf;
+}
+
+_CSV_EXPORT void csv_index_close(CsvIndex *idx) {
+    if(idx->csv)
+        fclose(idx->csv);
+    if(idx->index)
+        fclose(idx->index);
+    idx->csv = idx->index = NULL;
+}
+
 #  endif /* CSV_IMPLEMENTATION */
 
 #ifdef __cplusplus
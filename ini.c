@@ -62,57 +62,94 @@ const char *ini_errstr(int err)
 /** Configurable parameters *************************************************/
 
 /*
- *	Recursively adds sections to the tree of sections
+ *	Orders the nodes in the trees: by the hashes of their names first, and
+ *	only if the hashes are equal, case insensitively by the names themselves.
+ */
+static int key_cmp(unsigned int h1, const char *s1, size_t l1,
+					unsigned int h2, const char *s2, size_t l2) {
+	if(h1 != h2)
+		return h1 < h2 ? -1 : 1;
+	return my_slice_icmp(my_slice_n(s1, l1), my_slice_n(s2, l2));
+}
+
+/*
+ *	Computes the length and hash of a section's name
+ */
+static void section_key(ini_section *s) {
+	s->len = strlen(s->name);
+	s->hash = my_ihash(s->name, s->len);
+}
+
+/*
+ *	Computes the length and hash of a pair's parameter
+ */
+static void pair_key(ini_pair *p) {
+	p->len = strlen(p->param);
+	p->hash = my_ihash(p->param, p->len);
+}
+
+/*
+ *	Adds section n to the tree of sections r
  */
 static void insert_section(ini_section *r, ini_section *n) {	
 	assert(r);
 	assert(n);
 	
-	if(my_stricmp(r->name, n->name) < 0) {
-		if(!r->left) 
-			r->left = n;
-		else
-			insert_section(r->left, n);
-	} else {
-		if(!r->right) 
-			r->right = n;
-		else
-			insert_section(r->right, n);
-	}		
+	for(;;) {
+		if(key_cmp(r->hash, r->name, r->len, n->hash, n->name, n->len) < 0) {
+			if(!r->left) {
+				r->left = n;
+				return;
+			}
+			r = r->left;
+		} else {
+			if(!r->right) {
+				r->right = n;
+				return;
+			}
+			r = r->right;
+		}
+	}
 }
 
 /*
  *	Searches a tree of pairs for a specific parameter
  */
 static ini_pair *find_pair(ini_pair *root, const char *name) {
+	size_t len = strlen(name);
+	unsigned int hash = my_ihash(name, len);
 	int c;
 	
-	if(!root) return NULL;
-		
-	c = my_stricmp(root->param, name);
-	if(c == 0) 
-		return root;
-	else if(c < 0)
-		return find_pair(root->left, name);
-	else
-		return find_pair(root->right, name);
+	while(root) {
+		c = key_cmp(root->hash, root->param, root->len, hash, name, len);
+		if(c == 0) 
+			return root;
+		else if(c < 0)
+			root = root->left;
+		else
+			root = root->right;
+	}
+	return NULL;
 }
  
 /*
  *	Searches for a specific section
  */
 static ini_section *find_section(ini_section *root, const char *name) {
+	size_t len = strlen(name);
+	unsigned int hash = my_ihash(name, len);
 	int c;
 	
-	if(!root) return NULL;
-		
-	c = my_stricmp(root->name, name);
-	if(c == 0) 
-		return root;
-	else if(c < 0)
-		return find_section(root->left, name);
-	else
-		return find_section(root->right, name);	
+	while(root) {
+		c = key_cmp(root->hash, root->name, root->len, hash, name, len);
+		if(c == 0) 
+			return root;
+		else if(c < 0)
+			root = root->left;
+		else
+			root = root->right;
+	}
+	return NULL;
 }
 
 /*
@@ -134,6 +171,7 @@ static ini_section *add_section(ini_section **root, char *name) {
 	if(!n) return NULL;
 	
 	n->name = name;
+	section_key(n);
 	
 	n->fields = NULL;
 	n->left = n->right = NULL;
@@ -150,16 +188,20 @@ static ini_section *add_section(ini_section **root, char *name) {
  *	Inserts a new pair n into a pair tree p
  */
 static void insert_pair(ini_pair *p, ini_pair *n) {
-	if(my_stricmp(p->param, n->param) < 0) {
-		if(!p->left)
-			p->left = n;
-		else
-			insert_pair(p->left, n);
-	} else {		
-		if(!p->right)
-			p->right = n;
-		else
-			insert_pair(p->right, n);
+	for(;;) {
+		if(key_cmp(p->hash, p->param, p->len, n->hash, n->param, n->len) < 0) {
+			if(!p->left) {
+				p->left = n;
+				return;
+			}
+			p = p->left;
+		} else {		
+			if(!p->right) {
+				p->right = n;
+				return;
+			}
+			p = p->right;
+		}
 	}
 }
 
@@ -176,6 +218,7 @@ static ini_pair *add_pair(ini_section *s, char *p, char *v) {
 	
 	n->param = p;
 	n->value = v;
+	pair_key(n);
 	
 	n->left = n->right = NULL;
 	
@@ -247,13 +290,14 @@ struct ini_file *ini_read(const char *filename, int *err, int *line) {
 		if(err) *err = FILE_CREATED;
 		return make_ini();
 	} else {	
-		char *text = my_readfile(filename);
-		if(!text) {
+		my_filebuf fb;
+		struct ini_file *ini;
+		if(!my_loadfile(filename, &fb, MY_LOAD_SEQUENTIAL)) {
 			if(err) *err = NO_SUCH_FILE;
 			return NULL;
 		}
-		struct ini_file * ini = ini_parse(text, err, line);
-		free(text);
+		ini = ini_parse(fb.data, err, line);
+		my_freefile(&fb);
 		return ini;
 	}
 }
@@ -420,6 +464,7 @@ struct ini_file *ini_parse(const char *text, int *err, int *line) {
 				
 				pair->param = par;
 				pair->value = val;
+				pair_key(pair);
 				
 				pair->left = pair->right = NULL;
 					
@@ -597,6 +642,7 @@ int ini_put(struct ini_file *ini, const char *sec, const char *par, const char *
 				free(s);
 				return 0;
 			}
+			section_key(s);
 			
 			s->fields = NULL;
 			s->left = s->right = NULL;
@@ -618,6 +664,7 @@ int ini_put(struct ini_file *ini, const char *sec, const char *par, const char *
 		free(p);
 		return 0;
 	}
+	pair_key(p);
 	
 	p->left = p->right = NULL;
 	
@@ -29,6 +29,8 @@
 #ifndef INI_H
 #define INI_H
 
+#include <stddef.h>
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -36,13 +38,18 @@ extern "C" {
 /*
  *	Encapsulates a parameter-value pair in an INI section.
  *	Parameters are stored in a binary search tree, which attempts (but does not
- *	guarantee) O(log(n)) behaviour.
+ *	guarantee) O(log(n)) behaviour. The tree is ordered by the hash of the
+ *	parameters, so that most comparisons don't have to look at the strings.
  */
 typedef struct INI_PAIR
 {
 	char *param;		/* The parameter */
 	char *value;		/* Its value */
 
+	/* Length and case insensitive hash of the parameter */
+	size_t len;
+	unsigned int hash;
+
 	/* Nodes in the tree */
 	struct INI_PAIR *left, *right;
 } ini_pair;
@@ -50,13 +57,18 @@ typedef struct INI_PAIR
 /*
  *	Encapsulates a section within a INI file.
  *	Sections are stored in a binary search tree, which attempts (but does not
- *	guarantee) O(log(n)) behaviour.
+ *	guarantee) O(log(n)) behaviour. Like the parameters, it is ordered by the
+ *	hash of the names.
  */
 typedef struct INI_SECTION
 {
 	char *name;			/* Name of the section */
 	ini_pair *fields;	/* Fields in the section */
 
+	/* Length and case insensitive hash of the name */
+	size_t len;
+	unsigned int hash;
+
 	/* Nodes in the tree */
 	struct INI_SECTION *left, *right;
 } ini_section;
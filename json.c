@@ -127,12 +127,79 @@ typedef struct Array Array;
 #  define JSON_BAD_NUMBERS_AS_STRINGS 0
 #endif
 
+/*
+ * Objects with up to `JSON_SMALL_OBJECT` members store them in a small
+ * array inside the object's `HashTable` rather than in a separate hash
+ * table. The array is searched linearly, comparing the key pointers
+ * first (keys are often interned strings) and only then calling
+ * `strcmp()`. The members of small objects are serialized in the order
+ * in which they were added.
+ *
+ * The hash table is only allocated once an object outgrows the array.
+ */
+#ifndef JSON_SMALL_OBJECT
+#  define JSON_SMALL_OBJECT 8
+#endif
+
+/*
+ * `json_validate()` does not recurse or allocate memory; it keeps track
+ * of the nested objects and arrays in a fixed stack of `JSON_MAX_DEPTH`
+ * entries, and rejects documents that are nested deeper than that.
+ */
+#ifndef JSON_MAX_DEPTH
+#  define JSON_MAX_DEPTH 256
+#endif
+
+/*
+ * If `JSON_THREADS` is non-zero (the default), reference counts are
+ * changed with atomic operations, and the `JSON` entities that
+ * `json_array_get()` creates for the elements of packed arrays are
+ * stored with a compare-and-swap.
+ *
+ * A document can then be shared by several threads, each holding its own
+ * reference, as long as none of them modifies the shared values in
+ * place: the `*_cow()` functions copy shared objects and arrays before
+ * modifying them, so each thread can derive its own document from a
+ * template with `json_set_path_cow()`. The other functions that modify
+ * values must only be used on values that are not shared.
+ *
+ * The atomic operations are those of GCC and Clang or of Visual C++.
+ * With other compilers, or if `JSON_THREADS` is 0, documents must not be
+ * shared between threads.
+ */
+#ifndef JSON_THREADS
+#  define JSON_THREADS 1
+#endif
+
+#if JSON_THREADS && defined(__GNUC__)
+#  define ATOMIC_INC(p)         __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+#  define ATOMIC_DEC(p)         __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL)
+#  define ATOMIC_LOAD(p)        __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#  define ATOMIC_CAS(p, o, n)   __sync_bool_compare_and_swap(p, o, n)
+#elif JSON_THREADS && defined(_MSC_VER)
+#  include <windows.h>
+#  define ATOMIC_INC(p)         (sizeof *(p) == 8 ? (size_t)InterlockedIncrement64((volatile LONG64 *)(p)) \
+                                    : (size_t)InterlockedIncrement((volatile LONG *)(p)))
+#  define ATOMIC_DEC(p)         (sizeof *(p) == 8 ? (size_t)InterlockedDecrement64((volatile LONG64 *)(p)) \
+                                    : (size_t)InterlockedDecrement((volatile LONG *)(p)))
+#  define ATOMIC_LOAD(p)        (MemoryBarrier(), *(p))
+#  define ATOMIC_CAS(p, o, n)   (InterlockedCompareExchangePointer((PVOID volatile *)(p), (n), (o)) == (o))
+#else
+#  define ATOMIC_INC(p)         (++*(p))
+#  define ATOMIC_DEC(p)         (--*(p))
+#  define ATOMIC_LOAD(p)        (*(p))
+#  define ATOMIC_CAS(p, o, n)   (*(p) == (o) ? (*(p) = (n), 1) : 0)
+#endif
+
 /* =========================================================== */
 
 struct json {
 	JSON_Type type;
+    /* Non-zero if a `j_number` is stored in `value.integer` */
+    int is_int;
 	union {
         double number;
+        int64_t integer;
         char *string;
         HashTable *object;
         Array *array;
@@ -172,27 +239,33 @@ typedef struct HashElement {
     JSON *value;
 } HashElement;
 
+/* `table` is NULL while the members fit in `small` */
 struct HashTable {
     unsigned int allocated, count;
     HashElement *table;
+    HashElement small[JSON_SMALL_OBJECT];
 };
 
 static HashTable *ht_create() {
     HashTable *ht = malloc(sizeof *ht);
     if(!ht)
         return NULL;
-    ht->allocated = HASH_SIZE;
-    ht->table = calloc(ht->allocated, sizeof *ht->table);
-    if(!ht->table) {
-        free(ht);
-        return NULL;
-    }
+    ht->allocated = 0;
+    ht->table = NULL;
     ht->count = 0;
     return ht;
 }
 
 static void ht_destroy(HashTable *ht) {
     int i;
+    if(!ht->table) {
+        for(i = 0; i < ht->count; i++) {
+            str_release(ht->small[i].name);
+            json_release(ht->small[i].value);
+        }
+        free(ht);
+        return;
+    }
     for(i = 0; i < ht->allocated; i++) {
         if(ht->table[i].name) {
             HashElement* v = &ht->table[i];
@@ -217,8 +290,9 @@ static unsigned int hash(const char *s) {
     return h;
 }
 
-static HashElement *find_entry(HashElement *elements, unsigned int mask, const char *name) {
-    unsigned int h = hash(name) & mask;
+/* Finds `name` in a hash table, given its hash `h` */
+static HashElement *find_entry_hashed(HashElement *elements, unsigned int mask, const char *name, unsigned int h) {
+    h &= mask;
     for(;;) {
         if(!elements[h].name || !strcmp(elements[h].name, name))
             return &elements[h];
@@ -227,9 +301,61 @@ static HashElement *find_entry(HashElement *elements, unsigned int mask, const c
     return NULL;
 }
 
+static HashElement *find_entry(HashElement *elements, unsigned int mask, const char *name) {
+    return find_entry_hashed(elements, mask, name, hash(name));
+}
+
+/* Finds `name` in the members of a small object; returns -1 if it is not there */
+static int find_small(HashTable *ht, const char *name) {
+    int i;
+    for(i = 0; i < ht->count; i++)
+        if(ht->small[i].name == name)
+            return i;
+    for(i = 0; i < ht->count; i++)
+        if(!strcmp(ht->small[i].name, name))
+            return i;
+    return -1;
+}
+
+/* Moves the members of a small object into a hash table */
+static int ht_promote(HashTable *ht) {
+    unsigned int i, size = HASH_SIZE;
+    HashElement *table;
+    while(ht->count >= size * 3 / 4)
+        size <<= 1;
+    table = calloc(size, sizeof *table);
+    if(!table)
+        return 0;
+    for(i = 0; i < ht->count; i++) {
+        HashElement *to = find_entry(table, size - 1, ht->small[i].name);
+        *to = ht->small[i];
+    }
+    ht->table = table;
+    ht->allocated = size;
+    return 1;
+}
+
 static JSON *ht_put(HashTable *ht, char *name, JSON *j) {
     assert(ht);
 
+    if(!ht->table) {
+        int i = find_small(ht, name);
+        if(i >= 0) {
+            /* Replacing an existing entry */
+            str_release(ht->small[i].name);
+            json_release(ht->small[i].value);
+        } else if(ht->count < JSON_SMALL_OBJECT) {
+            i = ht->count++;
+        } else if(!ht_promote(ht)) {
+            return NULL;
+        }
+        if(i >= 0) {
+            ht->small[i].name = name;
+            ht->small[i].value = j;
+            return j;
+        }
+    }
+
     HashElement *f = find_entry(ht->table, ht->allocated - 1, name);
     if(f->name) {
         /* Replacing an existing entry */
@@ -269,14 +395,34 @@ static JSON *ht_put(HashTable *ht, char *name, JSON *j) {
 }
 
 static JSON *ht_get(HashTable *ht, const char *name) {
+    if(!ht->table) {
+        int i = find_small(ht, name);
+        return i >= 0 ? ht->small[i].value : NULL;
+    }
     HashElement *v = find_entry(ht->table, ht->allocated - 1, name);
     if(v->name)
         return v->value;
     return NULL;
 }
 
+/* `ht_get()` for a `name` that has already been hashed */
+static JSON *ht_get_hashed(HashTable *ht, const char *name, unsigned int h) {
+    if(!ht->table) {
+        int i = find_small(ht, name);
+        return i >= 0 ? ht->small[i].value : NULL;
+    }
+    HashElement *v = find_entry_hashed(ht->table, ht->allocated - 1, name, h);
+    return v->name ? v->value : NULL;
+}
+
 static const char *ht_next(HashTable *ht, const char *name) {
     unsigned int h = 0;
+    if(!ht->table) {
+        int i = 0;
+        if(name && (i = find_small(ht, name) + 1) == 0)
+            return NULL;
+        return i < ht->count ? ht->small[i].name : NULL;
+    }
     assert(ht->count < ht->allocated);
     if(name) {
         int oh;
@@ -303,9 +449,25 @@ static const char *ht_next(HashTable *ht, const char *name) {
 
 #define ARRAY_INITIAL_SIZE  8
 
+/* Largest integer that a double holds exactly */
+#define MAX_EXACT_INT   INT64_C(9007199254740992)
+
+/*
+ * Arrays that contain only numbers are packed: their values are stored in
+ * `numbers`. The array is unpacked into boxed `JSON` values in `elements`
+ * when anything other than a number is added or set.
+ * While an array is packed, `elements` is NULL until `json_array_get()`
+ * boxes one of its numbers; it then caches the boxes, with NULL for the
+ * numbers that have not been retrieved.
+ * `ints` is non-zero while all the packed numbers were integers, so that
+ * they are boxed as such.
+ * Neither buffer is allocated until it is needed.
+ */
 struct Array {
     JSON **elements;
+    double *numbers;
     size_t n, a;
+    int packed, ints;
 };
 
 static Array *ar_create() {
@@ -313,37 +475,123 @@ static Array *ar_create() {
     if(!a)
         return NULL;
     a->n = 0;
-    a->a = ARRAY_INITIAL_SIZE;
-    a->elements = calloc(ARRAY_INITIAL_SIZE, sizeof *a->elements);
-    if(!a->elements) {
-        free(a);
-        return NULL;
-    }
+    a->a = 0;
+    a->packed = 1;
+    a->ints = 1;
+    a->elements = NULL;
+    a->numbers = NULL;
     return a;
 }
 
 static void ar_destroy(Array *a) {
     int i;
-    for(i = 0; i < a->n; i++)
-        json_release(a->elements[i]);
-    free(a->elements);
+    if(a->elements) {
+        for(i = 0; i < a->n; i++)
+            json_release(a->elements[i]);
+        free(a->elements);
+    }
+    free(a->numbers);
     free(a);
 }
 
-static JSON *ar_append(Array *a, JSON *v) {
-    if(a->n == a->a) {
-        a->a += a->a >> 1;
-        JSON **old = a->elements;
-        a->elements = realloc(a->elements, a->a * sizeof *a->elements);
-        if(!a->elements) {
-            a->elements = old;
-            return NULL;
+/* Makes space for one more element */
+static int ar_grow(Array *a) {
+    size_t na, i;
+    if(a->n < a->a)
+        return 1;
+    na = a->a ? a->a + (a->a >> 1) : ARRAY_INITIAL_SIZE;
+    if(a->packed) {
+        double *nn = realloc(a->numbers, na * sizeof *nn);
+        if(!nn)
+            return 0;
+        a->numbers = nn;
+    }
+    if(!a->packed || a->elements) {
+        JSON **ne = realloc(a->elements, na * sizeof *ne);
+        if(!ne)
+            return 0;
+        a->elements = ne;
+        if(a->packed) {
+            for(i = a->a; i < na; i++)
+                ne[i] = NULL;
+        }
+    }
+    a->a = na;
+    return 1;
+}
+
+/* Allocates the boxes of a packed array, all NULL.
+Threads that read the same array may race to do this, so the boxes are
+stored with a compare-and-swap (see `JSON_THREADS`) */
+static int ar_boxes(Array *a) {
+    JSON **elements;
+    size_t i;
+    if(ATOMIC_LOAD(&a->elements) || !a->a)
+        return 1;
+    if(!(elements = malloc(a->a * sizeof *elements)))
+        return 0;
+    for(i = 0; i < a->a; i++)
+        elements[i] = NULL;
+    if(!ATOMIC_CAS(&a->elements, NULL, elements))
+        free(elements);
+    return 1;
+}
+
+/* Returns the box of the `i`'th number of a packed array, creating it
+if needed */
+static JSON *ar_box(Array *a, size_t i) {
+    JSON *v;
+    assert(a->packed && i < a->n);
+    if(!ar_boxes(a))
+        return NULL;
+    if(!(v = ATOMIC_LOAD(&a->elements[i]))) {
+        if(a->ints)
+            v = json_new_int64((int64_t)a->numbers[i]);
+        else
+            v = json_new_number(a->numbers[i]);
+        if(v && !ATOMIC_CAS(&a->elements[i], NULL, v)) {
+            json_release(v);
+            v = ATOMIC_LOAD(&a->elements[i]);
         }
     }
-    a->elements[a->n++] = v;
     return v;
 }
 
+/* Boxes all the numbers of a packed array */
+static int ar_unpack(Array *a) {
+    size_t i;
+    if(!a->packed)
+        return 1;
+    if(!ar_boxes(a))
+        return 0;
+    for(i = 0; i < a->n; i++) {
+        if(!ar_box(a, i))
+            return 0;
+    }
+    free(a->numbers);
+    a->numbers = NULL;
+    a->packed = 0;
+    return 1;
+}
+
+/* Appends a number to a packed array */
+static int ar_append_number(Array *a, double d, int is_int) {
+    assert(a->packed);
+    if(!ar_grow(a))
+        return 0;
+    a->numbers[a->n++] = d;
+    if(!is_int)
+        a->ints = 0;
+    return 1;
+}
+
+static int ar_append(Array *a, JSON *v) {
+    if(!ar_unpack(a) || !ar_grow(a))
+        return 0;
+    a->elements[a->n++] = v;
+    return 1;
+}
+
 /* =============================================================
   String Interning
 
@@ -388,13 +636,13 @@ static char *str_make(const char *str) {
 
 static void str_release(char *str) {
     unsigned int *rc = (unsigned int *)(str - sizeof *rc);
-    if(--(*rc) == 0)
+    if(ATOMIC_DEC(rc) == 0)
         free(rc);
 }
 
 static char *str_retain(char *str) {
     unsigned int *rc = (unsigned int *)(str - sizeof *rc);
-    (*rc)++;
+    ATOMIC_INC(rc);
     return str;
 }
 
@@ -645,18 +893,17 @@ static int emit(Emitter *e, char c) {
     return 1;
 }
 
-static int emit_text(Emitter *e, const char *t) {
-    size_t len = strlen(t);
+static int emit_n(Emitter *e, const char *t, size_t len) {
     if(e->a < e->n + len + 1) {
-        assert(e->a > 1);
-        while(e->a < e->n + len + 1)
-            e->a += e->a >> 1;
-        char *old = e->buffer;
-        e->buffer = realloc(e->buffer, e->a);
-        if(!e->buffer) {
-            e->buffer = old;
+        size_t na = e->a;
+        assert(na > 1);
+        while(na < e->n + len + 1)
+            na += na >> 1;
+        char *nb = realloc(e->buffer, na);
+        if(!nb)
             return 0;
-        }
+        e->buffer = nb;
+        e->a = na;
     }
     memcpy(e->buffer + e->n, t, len);
     e->n += len;
@@ -665,6 +912,10 @@ static int emit_text(Emitter *e, const char *t) {
     return 1;
 }
 
+static int emit_text(Emitter *e, const char *t) {
+    return emit_n(e, t, strlen(t));
+}
+
 static int init_emitter(Emitter *e, size_t initial_size) {
 
     e->a = initial_size;
@@ -693,10 +944,20 @@ static int init_emitter(Emitter *e, size_t initial_size) {
 #define P_BOM       99
 
 typedef struct  {
-    const char *in;
+    const char *in, *end;
+    /* Start of the current symbol */
+    const char *token;
 	int sym;
 	int lineno;
 
+    /* If zero, getsym() only checks the input without copying the text of
+    the symbols, so that no memory is allocated */
+    int build;
+
+    /* Value of a P_NUMBER symbol without a fraction or exponent */
+    int is_int;
+    int64_t integer;
+
 	Emitter e;
 #if JSON_INTERN_STRINGS
     TreeNodes internNodes;
@@ -707,10 +968,13 @@ typedef struct  {
 
 static int getsym(ParserContext *pc);
 
-static int init_parser(ParserContext *pc, const char *text) {
+static int init_parser(ParserContext *pc, const char *text, size_t len) {
     pc->in = text;
+    pc->end = text + len;
     pc->sym = 0;
     pc->lineno = 1;
+    pc->is_int = 0;
+    pc->build = 1;
 
     if(!init_emitter(&pc->e, 32))
         return 0;
@@ -738,16 +1002,22 @@ static int init_parser(ParserContext *pc, const char *text) {
 }
 
 static void start_text(ParserContext *pc) {
+    if(!pc->build)
+        return;
     pc->e.n = 0;
     pc->e.buffer[0] = '\0';
 }
 
 static int append_char(ParserContext *pc, char c) {
+    if(!pc->build)
+        return 1;
     return emit(&pc->e, c);
 }
 
 static void set_textf(ParserContext *pc, const char *fmt, ...) {
 	va_list arg;
+	if(!pc->e.buffer)
+		return;
 	va_start(arg, fmt);
     char buffer[64];
 	vsnprintf(buffer, sizeof buffer, fmt, arg);
@@ -786,8 +1056,11 @@ static void codepoint_to_utf8(ParserContext *pc, uint32_t cp) {
     }
 }
 
+/* The character `k` places ahead in the input, or '\0' past its end */
+#define CH(pc, k)   ((pc)->in + (k) < (pc)->end ? (pc)->in[k] : '\0')
+
 static int check_4_hex_digits(ParserContext *pc) {
-    return isxdigit(pc->in[0]) && isxdigit(pc->in[1]) && isxdigit(pc->in[2]) && isxdigit(pc->in[3]);
+    return isxdigit(CH(pc, 0)) && isxdigit(CH(pc, 1)) && isxdigit(CH(pc, 2)) && isxdigit(CH(pc, 3));
 }
 
 static uint32_t read_4_hex_digits(ParserContext *pc) {
@@ -802,6 +1075,11 @@ static uint32_t read_4_hex_digits(ParserContext *pc) {
     return u;
 }
 
+/* Compares the keyword of `len` letters at the input to `kw` */
+static int is_keyword(ParserContext *pc, size_t len, const char *kw) {
+    return strlen(kw) == len && !memcmp(pc->in, kw, len);
+}
+
 static int getsym(ParserContext *pc) {
 
 #if JSON_COMMENTS
@@ -810,25 +1088,26 @@ start:
 
     /* if(pc->sym == P_ERROR) return P_ERROR; */
 
-    if(pc->in[0] == '\0') {
-        return (pc->sym = P_END);
-    }
-	while(isspace(pc->in[0])) {
+	while(isspace(CH(pc, 0))) {
 		if(pc->in[0] == '\n')
 			pc->lineno++;
 		pc->in++;
 	}
+    pc->token = pc->in;
+    if(pc->in >= pc->end) {
+        return (pc->sym = P_END);
+    }
 
 #if JSON_COMMENTS
-	if(pc->in[0] == '/' && pc->in[1] == '/') {
+	if(pc->in[0] == '/' && CH(pc, 1) == '/') {
 		pc->in += 2;
-        while(pc->in[0] != '\n' && pc->in[0] != '\0')
+        while(CH(pc, 0) != '\n' && CH(pc, 0) != '\0')
 			pc->in++;
 		goto start;
-	} else if(pc->in[0] == '/' && pc->in[1] == '*') {
+	} else if(pc->in[0] == '/' && CH(pc, 1) == '*') {
         pc->in += 2;
-        while(pc->in[0] != '*' && pc->in[1] != '/') {
-            if(pc->in[0] == '\0') {
+        while(CH(pc, 0) != '*' || CH(pc, 1) != '/') {
+            if(CH(pc, 0) == '\0') {
                 set_textf(pc, "unexpected end of file");
 				return (pc->sym = P_ERROR);
             } else if(pc->in[0] == '\n')
@@ -839,50 +1118,78 @@ start:
 		goto start;
     }
 #else
-    if(pc->in[0] == '/' && (pc->in[1] == '/' || pc->in[1] == '*')) {
+    if(pc->in[0] == '/' && (CH(pc, 1) == '/' || CH(pc, 1) == '*')) {
         set_textf(pc, "comments are not supported");
         return (pc->sym = P_ERROR);
 	}
 #endif
 
+    pc->token = pc->in;
     start_text(pc);
 
     if(isalpha(pc->in[0])) {
-		while(isalpha(pc->in[0]))
-			append_char(pc, *(pc->in++));
-        if(!strcmp(pc->e.buffer, "null"))
-            return (pc->sym = P_NULL);
-        else if(!strcmp(pc->e.buffer, "true"))
-            return (pc->sym = P_TRUE);
-        else if(!strcmp(pc->e.buffer, "false"))
-            return (pc->sym = P_FALSE);
-
-        set_textf(pc, "unknown keyword '%s'", pc->e.buffer);
-        return (pc->sym = P_ERROR);
+        size_t len = 1;
+		while(isalpha(CH(pc, len)))
+			len++;
+        if(is_keyword(pc, len, "null"))
+            pc->sym = P_NULL;
+        else if(is_keyword(pc, len, "true"))
+            pc->sym = P_TRUE;
+        else if(is_keyword(pc, len, "false"))
+            pc->sym = P_FALSE;
+        else {
+            set_textf(pc, "unknown keyword '%.*s'", (int)len, pc->in);
+            return (pc->sym = P_ERROR);
+        }
+        pc->in += len;
+        return pc->sym;
 
 	} else if(isdigit(pc->in[0]) || pc->in[0] == '-') {
+        /* Integers are converted while they are scanned; only numbers
+        with a fraction or exponent (or that don't fit in 64 bits) are
+        copied to the buffer for atof() */
+        const char *start = pc->in;
+        uint64_t u = 0;
+        int neg = 0, digits = 0, overflow = 0;
 		pc->sym = P_NUMBER;
-        if(pc->in[0] == '-')
-			append_char(pc, *(pc->in++));
-		while(isdigit(pc->in[0]))
-			append_char(pc, *(pc->in++));
-		if(pc->in[0] == '.') {
-			append_char(pc, *(pc->in++));
-			while(isdigit(pc->in[0]))
-				append_char(pc, *(pc->in++));
+        if(pc->in[0] == '-') {
+            neg = 1;
+			pc->in++;
+        }
+		while(isdigit(CH(pc, 0))) {
+            unsigned int d = *(pc->in++) - '0';
+            if(u > (UINT64_MAX - d) / 10)
+                overflow = 1;
+            u = u * 10 + d;
+            digits++;
+        }
+        pc->is_int = digits && !overflow && !(neg && u == 0)
+                && (neg ? u <= (uint64_t)INT64_MAX + 1 : u <= (uint64_t)INT64_MAX);
+		if(CH(pc, 0) == '.') {
+            pc->is_int = 0;
+			pc->in++;
+			while(isdigit(CH(pc, 0)))
+				pc->in++;
 		}
-		if(tolower(pc->in[0]) == 'e') {
-			append_char(pc, *(pc->in++));
-			if(strchr("+-", pc->in[0]))
-				append_char(pc, *(pc->in++));
-			while(isdigit(pc->in[0]))
-				append_char(pc, *(pc->in++));
+		if(tolower(CH(pc, 0)) == 'e') {
+            pc->is_int = 0;
+			pc->in++;
+			if(CH(pc, 0) == '+' || CH(pc, 0) == '-')
+				pc->in++;
+			while(isdigit(CH(pc, 0)))
+				pc->in++;
 		}
+        if(pc->is_int) {
+            pc->integer = neg ? (int64_t)(0 - u) : (int64_t)u;
+        } else {
+            for(; start < pc->in; start++)
+                append_char(pc, *start);
+        }
         return (pc->sym = P_NUMBER);
 	} else if(pc->in[0] == '"') {
 		pc->in++;
-		while(pc->in[0] != '"') {
-			switch(pc->in[0]) {
+		while(CH(pc, 0) != '"') {
+			switch(CH(pc, 0)) {
 				case '\0' :
 				case '\n' : {
 						set_textf(pc, "unterminated string literal");
@@ -890,7 +1197,7 @@ start:
 					}
 				case '\\' : {
 						pc->in++;
-						switch(pc->in[0]) {
+						switch(CH(pc, 0)) {
 							case '\0' : {
 									set_textf(pc, "unterminated string literal");
 									return (pc->sym = P_ERROR);
@@ -909,7 +1216,7 @@ start:
                                     uint32_t u = read_4_hex_digits(pc);
                                     if(u >= 0xD800 && u <= 0xDFFF) {
                                         /* surrogate pair */
-                                        if(pc->in[0] != '\\' && pc->in[1]!='u') {
+                                        if(CH(pc, 0) != '\\' || CH(pc, 1) != 'u') {
                                             set_textf(pc, "expected a surrogate pair with \\u%04X", u);
 									        return (pc->sym = P_ERROR);
                                         }
@@ -940,7 +1247,7 @@ start:
 		}
 		pc->in++;
         return (pc->sym = P_STRING);
-	} else if(strchr("{}[]:,", pc->in[0])) {
+	} else if(pc->in[0] && strchr("{}[]:,", pc->in[0])) {
 		return (pc->sym = *(pc->in++));
 	} else {
 		set_textf(pc, "Unexpected token '%c'", pc->in[0]);
@@ -953,14 +1260,14 @@ start:
 ============================================================= */
 
 JSON *json_retain(JSON *j) {
-    j->refcount++;
+    ATOMIC_INC(&j->refcount);
     return j;
 }
 
 void json_release(JSON *j) {
     if(!j)
         return;
-    if(--j->refcount == 0) {
+    if(ATOMIC_DEC(&j->refcount) == 0) {
         switch(j->type) {
             case j_string: str_release(j->value.string); break;
             case j_object: ht_destroy(j->value.object); break;
@@ -1058,10 +1365,29 @@ static JSON *json_parse_array(ParserContext *pc) {
 	accept(pc, '[');
 	if(pc->sym != ']') {
 		do {
+            Array *a = v->value.array;
+            if(a->packed && pc->sym == P_NUMBER
+                && (!pc->is_int || (pc->integer <= MAX_EXACT_INT && pc->integer >= -MAX_EXACT_INT))) {
+                /* Still packed: store the number directly */
+                if(!ar_append_number(a, pc->is_int ? (double)pc->integer : atof(pc->e.buffer), pc->is_int)) {
+                    json_error("out of memory");
+                    goto error;
+                }
+                getsym(pc);
+                if(pc->sym == P_ERROR) {
+                    json_error("line %d: %s", pc->lineno, pc->e.buffer);
+                    goto error;
+                }
+                continue;
+            }
 			JSON *value = json_parse_value(pc);
 			if(!value)
                 goto error;
-            ar_append(v->value.array, value);
+            if(!ar_append(a, value)) {
+                json_error("out of memory");
+                json_release(value);
+                goto error;
+            }
 		} while(accept(pc, ','));
 	}
 	if(!accept(pc, ']')) {
@@ -1085,7 +1411,10 @@ static JSON *json_parse_value(ParserContext *pc) {
 	else {
         JSON *v = NULL;
 		if(pc->sym == P_NUMBER) {
-			v = json_new_number(atof(pc->e.buffer));
+            if(pc->is_int)
+                v = json_new_int64(pc->integer);
+            else
+			    v = json_new_number(atof(pc->e.buffer));
 		} else if(pc->sym == P_STRING) {
             v = malloc(sizeof *v);
             if(v) {
@@ -1127,7 +1456,7 @@ JSON *json_parse(const char *text) {
     if(!memcmp("\xEF\xBB\xBF",text,3))
         text += 3;
 
-    if(!init_parser(&pc, text)) {
+    if(!init_parser(&pc, text, strlen(text))) {
         return NULL;
     }
 
@@ -1137,6 +1466,240 @@ JSON *json_parse(const char *text) {
     return j;
 }
 
+/* Skips over the value at the current symbol without building it.
+Nested objects and arrays are only matched by counting brackets */
+static int skip_value(ParserContext *pc) {
+    int depth = 0;
+    pc->build = 0;
+    for(;;) {
+        if(pc->sym == '{' || pc->sym == '[')
+            depth++;
+        else if(pc->sym == '}' || pc->sym == ']')
+            depth--;
+        else if(pc->sym == P_ERROR || pc->sym == P_END || (!depth && (pc->sym == ',' || pc->sym == ':')))
+            break;
+        if(depth <= 0)
+            break;
+        getsym(pc);
+    }
+    pc->build = 1;
+    if(depth < 0 || pc->sym == P_END || pc->sym == ',' || pc->sym == ':') {
+        json_error("line %d: value expected", pc->lineno);
+        return 0;
+    } else if(pc->sym == P_ERROR) {
+        json_error("line %d: %s", pc->lineno, pc->e.buffer);
+        return 0;
+    }
+    getsym(pc);
+    if(pc->sym == P_ERROR) {
+        json_error("line %d: %s", pc->lineno, pc->e.buffer);
+        return 0;
+    }
+    return 1;
+}
+
+/* Length of the component of a dotted path at `pos` if it matches `key`, -1 otherwise */
+static int path_match(const char *pos, const char *key) {
+    size_t len = strcspn(pos, ".");
+    if(strlen(key) != len || memcmp(pos, key, len))
+        return -1;
+    return (int)len;
+}
+
+/* Parses the object at the current symbol, keeping only the members
+selected by the paths in `pos`. Inactive paths are `NULL` */
+static JSON *json_parse_projected(ParserContext *pc, const char **pos, int n) {
+    const char **child = NULL;
+    int i;
+
+	JSON *v = json_new_object();
+    if(!v) {
+        json_error("out of memory");
+        return NULL;
+    }
+
+    accept(pc, '{');
+	if(pc->sym != '}') {
+		do {
+			char *key = NULL;
+			JSON *value = NULL;
+            int whole = 0, nested = 0;
+			if(pc->sym != P_STRING) {
+                json_error("line %d: string expected", pc->lineno);
+                goto error;
+            }
+            for(i = 0; i < n; i++) {
+                int len = pos[i] ? path_match(pos[i], pc->e.buffer) : -1;
+                if(len >= 0 && !pos[i][len]) {
+                    whole = 1;
+                } else if(len >= 0) {
+                    if(!child && !(child = malloc(n * sizeof *child))) {
+                        json_error("out of memory");
+                        goto error;
+                    }
+                    if(!nested)
+                        memset(child, 0, n * sizeof *child);
+                    child[i] = pos[i] + len + 1;
+                    nested = 1;
+                }
+            }
+            /* Not interned, since the key is dropped if its value is skipped */
+            if((whole || nested) && !(key = str_make(pc->e.buffer))) {
+                json_error("out of memory");
+                goto error;
+            }
+            getsym(pc);
+            if(pc->sym == P_ERROR) {
+                json_error("line %d: %s", pc->lineno, pc->e.buffer);
+                if(key) str_release(key);
+                goto error;
+            }
+
+            /* Don't copy the first symbol of a value that gets skipped */
+            pc->build = whole || nested;
+			if(!accept(pc, ':')) {
+                if(pc->sym != P_ERROR)
+                    json_error("line %d: ':' expected", pc->lineno);
+				if(key) str_release(key);
+                goto error;
+            }
+
+            if(whole) {
+                value = json_parse_value(pc);
+                if(!value) {
+                    str_release(key);
+                    goto error;
+                }
+            } else if(nested && pc->sym == '{') {
+                value = json_parse_projected(pc, child, n);
+                if(!value) {
+                    str_release(key);
+                    goto error;
+                }
+                /* None of the paths through it were found */
+                if(!value->value.object->count) {
+                    json_release(value);
+                    str_release(key);
+                    continue;
+                }
+            } else {
+                if(key)
+                    str_release(key);
+                if(!skip_value(pc))
+                    goto error;
+                continue;
+            }
+
+			ht_put(v->value.object, key, value);
+
+		} while(accept(pc, ','));
+	}
+
+	if(!accept(pc, '}')) {
+		json_error("line %d: '}' expected", pc->lineno);
+		goto error;
+	}
+
+    free(child);
+	return v;
+
+error:
+    free(child);
+    ht_destroy(v->value.object);
+    free(v);
+    return NULL;
+}
+
+JSON *json_parse_projection(const char *text, const char *paths[], int n) {
+    ParserContext pc;
+    JSON *j = NULL;
+
+    if(strlen(text) >= 3 && !memcmp("\xEF\xBB\xBF", text, 3))
+        text += 3;
+
+    if(!init_parser(&pc, text, strlen(text))) {
+        return NULL;
+    }
+
+    if(pc.sym != '{')
+        json_error("line %d: '{' expected", pc.lineno);
+    else
+        j = json_parse_projected(&pc, paths, n);
+
+    destroy_parser(&pc);
+    return j;
+}
+
+int json_validate(const char *text, size_t len, size_t *err_offset) {
+    ParserContext pc;
+    char stack[JSON_MAX_DEPTH];
+    int sp = 0;
+
+    /* Skip a BOM, if present */
+    if(len >= 3 && !memcmp("\xEF\xBB\xBF", text, 3))
+        pc.in = text + 3;
+    else
+        pc.in = text;
+    pc.end = text + len;
+    pc.sym = 0;
+    pc.lineno = 1;
+    pc.build = 0;
+    pc.e.buffer = NULL;
+
+    getsym(&pc);
+    for(;;) {
+        /* Expect a value */
+        if(pc.sym == '{' || pc.sym == '[') {
+            if(sp == JSON_MAX_DEPTH)
+                goto error;
+            stack[sp++] = pc.sym;
+            getsym(&pc);
+            if(pc.sym == (stack[sp-1] == '{' ? '}' : ']')) {
+                /* empty object or array */
+                sp--;
+                getsym(&pc);
+            } else if(stack[sp-1] == '{') {
+                if(pc.sym != P_STRING || getsym(&pc) != ':')
+                    goto error;
+                getsym(&pc);
+                continue;
+            } else
+                continue;
+        } else if(pc.sym >= P_NUMBER && pc.sym <= P_FALSE) {
+            getsym(&pc);
+        } else
+            goto error;
+
+        /* After a value: close the enclosing objects and arrays, or
+        move on to their next member */
+        for(;;) {
+            if(!sp) {
+                if(pc.sym != P_END)
+                    goto error;
+                return 1;
+            }
+            if(pc.sym == (stack[sp-1] == '{' ? '}' : ']')) {
+                sp--;
+                getsym(&pc);
+            } else if(pc.sym == ',') {
+                getsym(&pc);
+                if(stack[sp-1] == '{') {
+                    if(pc.sym != P_STRING || getsym(&pc) != ':')
+                        goto error;
+                    getsym(&pc);
+                }
+                break;
+            } else
+                goto error;
+        }
+    }
+
+error:
+    if(err_offset)
+        *err_offset = (pc.sym == P_ERROR ? pc.in : pc.token) - text;
+    return 0;
+}
+
 /* =============================================================
   Utility Functions
 ============================================================= */
@@ -1154,32 +1717,41 @@ static int _json_error(const char *fmt, ...) {
 }
 
 /* Reads an entire file into a dynamically allocated memory buffer.
- * The returned buffer needs to be free()d afterwards
+ * The returned buffer needs to be free()d afterwards.
+ * The file is read in growing chunks rather than through fseek()/ftell(),
+ * so that pipes can be read as well.
  */
 static char *_json_readfile(const char *fname) {
 	FILE *f;
-	long len,r;
-	char *str;
+	size_t len = 0, cap = 0, r;
+	char *str = NULL, *ns;
 
 	if(!(f = fopen(fname, "rb")))
 		return NULL;
 
-	fseek(f, 0, SEEK_END);
-	len = ftell(f);
-	rewind(f);
-
-	if(!(str = malloc(len+2)))
-		return NULL;
-	r = fread(str, 1, len, f);
-
-	if(r != len) {
-		free(str);
-		return NULL;
+	for(;;) {
+		if(cap - len < 2) {
+			cap = cap ? cap << 1 : 65536;
+			if(!(ns = realloc(str, cap)))
+				goto error;
+			str = ns;
+		}
+		r = fread(str + len, 1, cap - len - 1, f);
+		len += r;
+		if(r == 0) {
+			if(ferror(f))
+				goto error;
+			break;
+		}
 	}
 
 	fclose(f);
 	str[len] = '\0';
 	return str;
+error:
+	fclose(f);
+	free(str);
+	return NULL;
 }
 
 JSON *json_read(const char *filename) {
@@ -1196,33 +1768,130 @@ JSON *json_read(const char *filename) {
 
 #define EMIT(e,c) do{if(!emit(e,c)) return 0;}while(0);
 
+/* Characters that have to be escaped in JSON strings */
+#define NEEDS_ESCAPE(c) ((unsigned char)(c) < 0x20 || (c) == '"' || (c) == '\\')
+
+/* Tests 8 bytes at a time for characters that need escaping:
+ * `(x - ONES * n) & ~x & HIGHS` is non-zero if any byte in `x` is less than `n`
+ */
+#define ONES    UINT64_C(0x0101010101010101)
+#define HIGHS   (ONES * 0x80)
+#define HAS_LESS(x, n)  (((x) - ONES * (n)) & ~(x) & HIGHS)
+
+static int word_needs_escape(uint64_t w) {
+    return (HAS_LESS(w, 0x20) | HAS_LESS(w ^ (ONES * '"'), 1) | HAS_LESS(w ^ (ONES * '\\'), 1)) != 0;
+}
+
+/* Runs of characters that don't need escaping are found a word at a time
+ * and copied to the output with a single `emit_n()`.
+ */
 static int serialize_string(Emitter *e, const char *str) {
+    static const char hex[] = "0123456789abcdef";
+    size_t len, i = 0, start = 0;
+    uint64_t w;
+    char esc[6];
+
     assert(str);
+    len = strlen(str);
     EMIT(e,'"');
-    while(*str) {
-        if(strchr("\"\\/\b\f\n\r\t",*str)) {
-            EMIT(e, '\\');
-            switch(*str) {
-                case '\"': EMIT(e, '"'); break;
-                case '\\': EMIT(e, '\\'); break;
-                case '/': EMIT(e, '/'); break;
-                case '\b': EMIT(e, 'b'); break;
-                case '\f': EMIT(e, 'f'); break;
-                case '\n': EMIT(e, 'n'); break;
-                case '\r': EMIT(e, 'r'); break;
-                case '\t': EMIT(e, 't'); break;
-            }
-            /* Note: \uXXXX cases for unicode characters aren't implemented */
+    for(;;) {
+        while(i + 8 <= len) {
+            memcpy(&w, str + i, 8);
+            if(word_needs_escape(w))
+                break;
+            i += 8;
         }
-        else
-            EMIT(e, *str);
-        str++;
+        while(i < len && !NEEDS_ESCAPE(str[i]))
+            i++;
+        if(i > start && !emit_n(e, str + start, i - start))
+            return 0;
+        if(i == len)
+            break;
+
+        esc[0] = '\\';
+        switch(str[i]) {
+            case '\"': esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[(str[i] >> 4) & 0x0F];
+                esc[5] = hex[str[i] & 0x0F];
+                if(!emit_n(e, esc, 6))
+                    return 0;
+                start = ++i;
+                continue;
+        }
+        if(!emit_n(e, esc, 2))
+            return 0;
+        start = ++i;
     }
     EMIT(e,'"');
     return 1;
 }
 
-static int serialize_value(Emitter *e, JSON *j, int pretty, int indent) {
+/* Writes `v` in decimal backwards from `end`, two digits at a time,
+ * and returns the start of the null-terminated string.
+ */
+static char *int64_to_str(char *end, int64_t v) {
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+    *--end = '\0';
+    while(u >= 100) {
+        unsigned int d = (unsigned int)(u % 100) * 2;
+        u /= 100;
+        *--end = pairs[d + 1];
+        *--end = pairs[d];
+    }
+    if(u >= 10) {
+        *--end = pairs[u * 2 + 1];
+        *--end = pairs[u * 2];
+    } else
+        *--end = (char)('0' + u);
+    if(v < 0)
+        *--end = '-';
+    return end;
+}
+
+/* Integral values that a double holds exactly are written in full rather
+ * than in the "%g" format, so that they aren't rounded.
+ */
+static int serialize_number(Emitter *e, double d) {
+    char buffer[32];
+    int prec;
+#if defined(isnan) && defined(INFINITY)
+    if(isnan(d) || d == INFINITY || d == -INFINITY) {
+#if JSON_BAD_NUMBERS_AS_STRINGS
+        if(isnan(d)) return emit_text(e, "\"NaN\"");
+        else if(d == INFINITY) return emit_text(e, "\"Infinity\"");
+        else return emit_text(e, "\"-Infinity\"");
+#else
+        return emit_text(e, "null");
+#endif
+    }
+#endif
+    if(d >= -MAX_EXACT_INT && d <= MAX_EXACT_INT && d == (double)(int64_t)d && (d != 0 || !signbit(d)))
+        return emit_text(e, int64_to_str(buffer + sizeof buffer, (int64_t)d));
+    /* The shortest form that reads back as the same value */
+    for(prec = 15; prec < 17; prec++) {
+        snprintf(buffer, sizeof buffer, "%.*g", prec, d);
+        if(strtod(buffer, NULL) == d)
+            return emit_text(e, buffer);
+    }
+    snprintf(buffer, sizeof buffer, "%.17g", d);
+    return emit_text(e, buffer);
+}
+
+static int serialize_value(Emitter *e, JSON *j, int pretty, int indent) {
     char buffer[32];
     int x;
     if(!j) {
@@ -1236,20 +1905,12 @@ static int serialize_value(Emitter *e, JSON *j, int pretty, int indent) {
                 return 0;
 		} break;
 		case j_number:
-#if defined(isnan) && defined(INFINITY)
-            if(isnan(j->value.number) || j->value.number == INFINITY || j->value.number == -INFINITY) {
-#if JSON_BAD_NUMBERS_AS_STRINGS
-                if(isnan(j->value.number)) emit_text(e, "\"NaN\"");
-                else if(j->value.number == INFINITY) emit_text(e, "\"Infinity\"");
-                else if(j->value.number == -INFINITY) emit_text(e, "\"-Infinity\"");
-#else
-                emit_text(e, "null");
-#endif
-                return 1;
+            if(j->is_int) {
+                if(!emit_text(e, int64_to_str(buffer + sizeof buffer, j->value.integer)))
+                    return 0;
+                break;
             }
-#endif
-            snprintf(buffer, sizeof buffer, "%g", j->value.number);
-            if(!emit_text(e, buffer))
+            if(!serialize_number(e, j->value.number))
                 return 0;
             break;
 		case j_object: {
@@ -1288,7 +1949,10 @@ static int serialize_value(Emitter *e, JSON *j, int pretty, int indent) {
 
                     if(pretty) for(x=0;x<indent*2;x++) EMIT(e, ' ');
 
-                    if(!serialize_value(e, a->elements[i], pretty, indent+1))
+                    if(!a->packed) {
+                        if(!serialize_value(e, a->elements[i], pretty, indent+1))
+                            return 0;
+                    } else if(!serialize_number(e, a->numbers[i]))
                         return 0;
                     if(i < a->n - 1)
                         EMIT(e, ',');
@@ -1327,6 +1991,17 @@ char *json_serialize(JSON *j) {
     return e.buffer;
 }
 
+char *json_escape(const char *str) {
+    Emitter e;
+    if(!init_emitter(&e, strlen(str) + 3))
+        return NULL;
+    if(!serialize_string(&e, str)) {
+        free(e.buffer);
+        return NULL;
+    }
+    return e.buffer;
+}
+
 char *json_pretty(JSON *j) {
     Emitter e;
     if(!init_emitter(&e, 256))
@@ -1338,6 +2013,232 @@ char *json_pretty(JSON *j) {
     return e.buffer;
 }
 
+/* =============================================================
+  Reformatting
+============================================================= */
+
+#ifndef JSON_REFORMAT_BUFFER
+#  define JSON_REFORMAT_BUFFER 16384
+#endif
+
+typedef struct {
+    FILE *in, *out;
+    size_t pos, len;
+    int lineno;
+    char buffer[JSON_REFORMAT_BUFFER];
+} Reformatter;
+
+static int rf_fill(Reformatter *r) {
+    r->pos = 0;
+    r->len = fread(r->buffer, 1, sizeof r->buffer, r->in);
+    return r->len > 0;
+}
+
+/* The next input character, or EOF */
+#define RF_PEEK(r) ((r)->pos < (r)->len || rf_fill(r) ? (unsigned char)(r)->buffer[(r)->pos] : EOF)
+
+static void rf_newline(Reformatter *r, int depth) {
+    int x;
+    putc('\n', r->out);
+    for(x = 0; x < depth * 2; x++)
+        putc(' ', r->out);
+}
+
+/* Skips a comment; the leading '/' has been consumed */
+static int rf_comment(Reformatter *r) {
+#if JSON_COMMENTS
+    int c = RF_PEEK(r);
+    if(c == '/') {
+        while((c = RF_PEEK(r)) != EOF && c != '\n')
+            r->pos++;
+        return 1;
+    } else if(c == '*') {
+        int star = 0;
+        r->pos++;
+        while((c = RF_PEEK(r)) != EOF) {
+            r->pos++;
+            if(c == '/' && star)
+                return 1;
+            if(c == '\n')
+                r->lineno++;
+            star = (c == '*');
+        }
+        json_error("line %d: unexpected end of file", r->lineno);
+        return 0;
+    }
+    json_error("line %d: Unexpected token '/'", r->lineno);
+#else
+    json_error("line %d: comments are not supported", r->lineno);
+#endif
+    return 0;
+}
+
+/* Copies a string verbatim; the opening quote has been consumed */
+static int rf_string(Reformatter *r) {
+    putc('"', r->out);
+    for(;;) {
+        size_t i;
+        if(RF_PEEK(r) == EOF)
+            break;
+        for(i = r->pos; i < r->len; i++) {
+            char c = r->buffer[i];
+            if(c == '"' || c == '\\' || c == '\n')
+                break;
+        }
+        fwrite(r->buffer + r->pos, 1, i - r->pos, r->out);
+        r->pos = i;
+        if(i == r->len)
+            continue;
+        if(r->buffer[i] == '\n')
+            break;
+        putc(r->buffer[r->pos++], r->out);
+        if(r->buffer[i] == '"')
+            return 1;
+        /* the character after a backslash */
+        if(RF_PEEK(r) == EOF)
+            break;
+        putc(r->buffer[r->pos++], r->out);
+    }
+    json_error("line %d: unterminated string literal", r->lineno);
+    return 0;
+}
+
+/* What `json_reformat()` expects next */
+#define RF_VALUE    0
+#define RF_KEY      1
+#define RF_COLON    2
+#define RF_NEXT     3
+
+/* Copies a number or keyword; `c` is its first character, which has
+been consumed */
+static int rf_token(Reformatter *r, int c) {
+    char word[6];
+    size_t n = 0;
+    int number = (isdigit(c) || c == '-');
+    for(;;) {
+        putc(c, r->out);
+        if(n < sizeof word)
+            word[n++] = c;
+        c = RF_PEEK(r);
+        if(c == EOF || isspace(c) || strchr("{}[],:\"/", c))
+            break;
+        r->pos++;
+    }
+    if(number)
+        return 1;
+    if(n < sizeof word) {
+        word[n] = '\0';
+        if(!strcmp(word, "null") || !strcmp(word, "true") || !strcmp(word, "false"))
+            return 1;
+    }
+    json_error("line %d: unknown keyword '%.*s'", r->lineno, (int)n, word);
+    return 0;
+}
+
+int json_reformat(FILE *in, FILE *out, int mode) {
+    Reformatter r;
+    char stack[JSON_MAX_DEPTH];
+    int c, sp = 0, opened = 0, expect = RF_VALUE, pretty = (mode == JSON_REFORMAT_PRETTY);
+
+    r.in = in;
+    r.out = out;
+    r.pos = r.len = 0;
+    r.lineno = 1;
+
+    /* Skip a BOM, if present */
+    if(rf_fill(&r) && r.len >= 3 && !memcmp("\xEF\xBB\xBF", r.buffer, 3))
+        r.pos = 3;
+
+    while((c = RF_PEEK(&r)) != EOF) {
+        r.pos++;
+        switch(c) {
+            case '\n': r.lineno++; break;
+            case ' ': case '\t': case '\r': break;
+            case '/':
+                if(!rf_comment(&r))
+                    return 0;
+                break;
+            case '{': case '[':
+                if(expect != RF_VALUE)
+                    goto unexpected;
+                if(sp == JSON_MAX_DEPTH) {
+                    json_error("line %d: too many nested objects and arrays", r.lineno);
+                    return 0;
+                }
+                if(pretty && opened)
+                    rf_newline(&r, sp);
+                putc(c, out);
+                stack[sp++] = c;
+                expect = (c == '{') ? RF_KEY : RF_VALUE;
+                opened = 1;
+                break;
+            case '}': case ']':
+                /* the bracket must match, and may only follow a value
+                or the opening bracket */
+                if(!sp || stack[sp-1] != (c == '}' ? '{' : '[')
+                        || (expect != RF_NEXT && !opened))
+                    goto unexpected;
+                sp--;
+                if(pretty && !opened)
+                    rf_newline(&r, sp);
+                putc(c, out);
+                opened = 0;
+                if(sp)
+                    expect = RF_NEXT;
+                else {
+                    putc('\n', out);
+                    expect = RF_VALUE;
+                }
+                break;
+            case ',':
+                if(expect != RF_NEXT)
+                    goto unexpected;
+                putc(',', out);
+                if(pretty)
+                    rf_newline(&r, sp);
+                expect = (stack[sp-1] == '{') ? RF_KEY : RF_VALUE;
+                break;
+            case ':':
+                if(expect != RF_COLON)
+                    goto unexpected;
+                fputs(pretty ? " : " : ":", out);
+                expect = RF_VALUE;
+                break;
+            default:
+                if(expect != RF_VALUE && !(expect == RF_KEY && c == '"'))
+                    goto unexpected;
+                if(pretty && opened)
+                    rf_newline(&r, sp);
+                opened = 0;
+                if(c == '"') {
+                    if(!rf_string(&r))
+                        return 0;
+                } else if(!rf_token(&r, c))
+                    return 0;
+                if(expect == RF_KEY)
+                    expect = RF_COLON;
+                else if(sp)
+                    expect = RF_NEXT;
+                else
+                    putc('\n', out);
+                break;
+        }
+    }
+    if(sp || expect != RF_VALUE) {
+        json_error("line %d: unexpected end of file", r.lineno);
+        return 0;
+    }
+    if(ferror(in) || ferror(out)) {
+        json_error("unable to reformat: I/O error");
+        return 0;
+    }
+    return 1;
+
+unexpected:
+    json_error("line %d: Unexpected token '%c'", r.lineno, c);
+    return 0;
+}
+
 /* =============================================================
   Accessors
 ============================================================= */
@@ -1347,6 +2248,7 @@ static JSON *new_value(JSON_Type type) {
     if(!j)
         return NULL;
     j->type = type;
+    j->is_int = 0;
     j->refcount = 1;
     return j;
 }
@@ -1394,6 +2296,15 @@ JSON *json_new_number(double n) {
     return v;
 }
 
+JSON *json_new_int64(int64_t n) {
+    JSON *v = new_value(j_number);
+    if(!v)
+        return NULL;
+    v->is_int = 1;
+    v->value.integer = n;
+    return v;
+}
+
 #if !JSON_REENTRANT
 static JSON *G_null = NULL, *G_true = NULL, *G_false = NULL;
 static void free_globals() {
@@ -1477,6 +2388,8 @@ int json_is_falsey(JSON *j) {
         return 1;
     if(j->type == j_string && strlen(j->value.string) == 0)
         return 1;
+    if(j->type == j_number && j->is_int)
+        return j->value.integer == 0;
 #ifdef isnan
     /* Technically, NaN is not part of JSON, but I included it here for
     completeness */
@@ -1493,6 +2406,10 @@ int json_is_number(JSON *j) {
 	return j->type == j_number;
 }
 
+int json_is_integer(JSON *j) {
+	return j->type == j_number && j->is_int;
+}
+
 int json_is_string(JSON *j) {
 	return j->type == j_string;
 }
@@ -1507,10 +2424,21 @@ int json_is_array(JSON *j) {
 
 double json_as_number(JSON *j) {
 	if(j->type == j_number)
-		return j->value.number;
+		return j->is_int ? (double)j->value.integer : j->value.number;
 	return 0.0;
 }
 
+int64_t json_as_int64(JSON *j) {
+	if(j->type == j_number) {
+        if(j->is_int)
+            return j->value.integer;
+        /* The range check also rejects NaN */
+        if(j->value.number >= -9223372036854775808.0 && j->value.number < 9223372036854775808.0)
+            return (int64_t)j->value.number;
+    }
+	return 0;
+}
+
 const char *json_as_string(JSON *j) {
 	if(j->type == j_string)
 		return j->value.string;
@@ -1624,12 +2552,28 @@ unsigned int json_array_len(JSON *j) {
 
 JSON *json_array_get(JSON *array, int n) {
 	assert(array->type == j_array);
-	if(n < array->value.array->n)
-        return array->value.array->elements[n];
+    Array *a = array->value.array;
+	if(n < a->n) {
+        JSON *v;
+        if(!a->packed)
+            return a->elements[n];
+        if(!(v = ar_box(a, n)))
+            json_error("out of memory");
+        return v;
+    }
 	return NULL;
 }
 
+const double *json_array_numbers(JSON *array) {
+	assert(array->type == j_array);
+    return array->value.array->packed ? array->value.array->numbers : NULL;
+}
+
 double json_array_get_number(JSON *array, int n) {
+	assert(array->type == j_array);
+    Array *a = array->value.array;
+    if(a->packed)
+        return n < a->n ? a->numbers[n] : 0.0;
     JSON *v = json_array_get(array, n);
     if(v)
         return json_as_number(v);
@@ -1646,6 +2590,11 @@ const char *json_array_get_string(JSON *array, int n) {
 JSON *json_array_set(JSON *j, int n, JSON *v) {
 	assert(j->type == j_array);
 	assert(n < j->value.array->n);
+    if(!ar_unpack(j->value.array)) {
+        json_error("out of memory");
+        json_release(v);
+        return j;
+    }
     JSON *old = j->value.array->elements[n];
     j->value.array->elements[n] = v;
     json_release(old);
@@ -1654,19 +2603,34 @@ JSON *json_array_set(JSON *j, int n, JSON *v) {
 
 JSON *json_array_reserve(JSON *j, unsigned int n) {
 	assert(j->type == j_array);
-    while(j->value.array->n < n)
-        ar_append(j->value.array, json_null());
+    while(j->value.array->n < n) {
+        JSON *v = json_null();
+        if(!v || !ar_append(j->value.array, v)) {
+            json_error("out of memory");
+            json_release(v);
+            break;
+        }
+    }
     return j;
 }
 
 JSON *json_array_add(JSON *array, JSON *value) {
     assert(array->type == j_array);
     if(!value) value = json_null();
-    ar_append(array->value.array, value);
+    if(!ar_append(array->value.array, value)) {
+        json_error("out of memory");
+        json_release(value);
+    }
     return array;
 }
 
 JSON *json_array_add_number(JSON *array, double number) {
+    assert(array->type == j_array);
+    if(array->value.array->packed) {
+        if(!ar_append_number(array->value.array, number, 0))
+            json_error("out of memory");
+        return array;
+    }
     return json_array_add(array, json_new_number(number));
 }
 
@@ -1674,3 +2638,751 @@ JSON *json_array_add_string(JSON *array, const char *str) {
     return json_array_add(array, json_new_string(str));
 }
 
+/* =============================================================
+  Copy-on-write updates
+============================================================= */
+
+/* Creates a new object or array with the same members as `j`, retaining
+them rather than copying them */
+static JSON *shallow_copy(JSON *j) {
+    JSON *c;
+    if(j->type == j_object) {
+        HashTable *h = j->value.object;
+        const char *key;
+        if(!(c = json_new_object()))
+            return NULL;
+        for(key = ht_next(h, NULL); key; key = ht_next(h, key)) {
+#if JSON_INTERN_STRINGS
+            char *k = str_retain((char *)key);
+#else
+            char *k = str_make(key);
+#endif
+            JSON *v = json_retain(ht_get(h, key));
+            if(!k || !ht_put(c->value.object, k, v)) {
+                if(k)
+                    str_release(k);
+                json_release(v);
+                json_release(c);
+                return NULL;
+            }
+        }
+    } else {
+        Array *a = j->value.array, *b;
+        size_t i;
+        assert(j->type == j_array);
+        if(!(c = json_new_array()))
+            return NULL;
+        b = c->value.array;
+        if(a->n) {
+            if(!a->packed) {
+                if(!(b->elements = malloc(a->n * sizeof *b->elements))) {
+                    json_release(c);
+                    return NULL;
+                }
+                for(i = 0; i < a->n; i++)
+                    b->elements[i] = json_retain(a->elements[i]);
+            } else {
+                if(!(b->numbers = malloc(a->n * sizeof *b->numbers))) {
+                    json_release(c);
+                    return NULL;
+                }
+                memcpy(b->numbers, a->numbers, a->n * sizeof *b->numbers);
+            }
+        }
+        b->n = b->a = a->n;
+        b->packed = a->packed;
+        b->ints = a->ints;
+    }
+    return c;
+}
+
+/* Returns `j` if it is not shared, otherwise a shallow copy of it that
+replaces the caller's reference to `j` */
+static JSON *cow_unshare(JSON *j) {
+    JSON *c;
+    if(ATOMIC_LOAD(&j->refcount) <= 1)
+        return j;
+    if(!(c = shallow_copy(j)))
+        return NULL;
+    json_release(j);
+    return c;
+}
+
+JSON *json_obj_set_cow(JSON *obj, char *k, JSON *v) {
+    JSON *c;
+    assert(obj->type == j_object);
+    if(!(c = cow_unshare(obj))) {
+        json_error("out of memory");
+        json_release(v);
+        return obj;
+    }
+    return json_obj_set(c, k, v);
+}
+
+JSON *json_array_set_cow(JSON *array, int n, JSON *v) {
+    JSON *c;
+    assert(array->type == j_array);
+    if(!(c = cow_unshare(array))) {
+        json_error("out of memory");
+        json_release(v);
+        return array;
+    }
+    return json_array_set(c, n, v);
+}
+
+/* Returns the index of `array` that `key` names, or -1 if it is invalid */
+static int path_index(JSON *array, const char *key) {
+    char *end;
+    long i;
+    if(!isdigit((unsigned char)key[0]))
+        return -1;
+    i = strtol(key, &end, 10);
+    if(*end || i >= (long)json_array_len(array))
+        return -1;
+    return (int)i;
+}
+
+JSON *json_set_path_cow(JSON *root, const char *path, JSON *v) {
+    JSON *node, *child;
+    char *p, *key;
+    int i, n, index;
+
+    if(root->type != j_object && root->type != j_array) {
+        json_error("unable to set '%s': not an object or array", path);
+        json_release(v);
+        return root;
+    }
+    if(!(p = malloc(strlen(path) + 1))) {
+        json_error("out of memory");
+        json_release(v);
+        return root;
+    }
+    strcpy(p, path);
+
+    /* Split the path into its `n` components */
+    for(n = 1, key = p; (key = strchr(key, '.')); n++)
+        *key++ = '\0';
+
+    /* Check the indices on the way down before anything is modified.
+    Past the first missing object or array, everything is created */
+    for(i = 0, key = p, node = root; ; i++, key += strlen(key) + 1) {
+        if(node->type == j_array) {
+            if((index = path_index(node, key)) < 0) {
+                json_error("unable to set '%s': bad index '%s'", path, key);
+                goto error;
+            }
+            child = node->value.array->packed ? NULL : node->value.array->elements[index];
+        } else
+            child = json_obj_get(node, key);
+        if(i == n - 1 || !child || (child->type != j_object && child->type != j_array))
+            break;
+        node = child;
+    }
+
+    if(!(node = cow_unshare(root)))
+        goto nomem;
+    root = node;
+
+    /* The nodes on the way down are unshared in their parent before
+    descending into them, so that only the last one is modified */
+    for(i = 0, key = p; i < n - 1; i++, key += strlen(key) + 1) {
+        if(node->type == j_object) {
+            child = json_obj_get(node, key);
+            if(!child || (child->type != j_object && child->type != j_array)) {
+                child = json_new_object();
+                if(!child)
+                    goto nomem;
+                json_obj_set(node, key, child);
+            } else if(ATOMIC_LOAD(&child->refcount) > 1) {
+                if(!(child = shallow_copy(child)))
+                    goto nomem;
+                json_obj_set(node, key, child);
+            }
+        } else {
+            index = path_index(node, key);
+            child = json_array_get(node, index);
+            if(!child)
+                goto nomem;
+            if(child->type != j_object && child->type != j_array)
+                child = json_new_object();
+            else if(ATOMIC_LOAD(&child->refcount) > 1)
+                child = shallow_copy(child);
+            else
+                child = json_retain(child);
+            if(!child)
+                goto nomem;
+            json_array_set(node, index, child);
+        }
+        node = child;
+    }
+
+    if(node->type == j_object)
+        json_obj_set(node, key, v);
+    else
+        json_array_set(node, path_index(node, key), v);
+    free(p);
+    return root;
+
+nomem:
+    json_error("out of memory");
+error:
+    json_release(v);
+    free(p);
+    return root;
+}
+
+/* =============================================================
+  Schemas
+============================================================= */
+
+/*
+ * A schema is compiled into a flat array of `SchemaNode`s, one for every
+ * (sub)schema, which refer to each other by index. The `properties` of
+ * every node are a contiguous range of the `props` array, sorted by the
+ * hash of their keys, which are hashed once at compile time.
+ */
+
+/* Bit for `"type":"integer"`; the other bits are `1 << JSON_Type` */
+#define SCHEMA_INTEGER  (1 << 7)
+
+typedef struct {
+    char *key;
+    unsigned int hash;
+    int node;           /* -1 if there are no constraints on the value */
+    int required;
+} SchemaProp;
+
+typedef struct {
+    unsigned int types; /* 0 for any type */
+    int has_min, has_max;
+    double min, max;
+    long max_length;    /* -1 if not specified */
+    int items;          /* -1 if not specified */
+    int props, nprops;
+    int nrequired;
+    int enums, nenums;
+} SchemaNode;
+
+struct json_schema {
+    SchemaNode *nodes;
+    int nnodes, anodes;
+    SchemaProp *props;
+    int nprops, aprops;
+    JSON **enums;
+    int nenums, aenums;
+};
+
+/* Location of the value being validated, as a JSON pointer */
+typedef struct {
+    char text[256];
+    size_t len;
+} SchemaPath;
+
+static size_t path_push(SchemaPath *p, const char *key, int index) {
+    size_t len = p->len;
+    int n;
+    if(key)
+        n = snprintf(p->text + len, sizeof p->text - len, "/%s", key);
+    else
+        n = snprintf(p->text + len, sizeof p->text - len, "/%d", index);
+    if(n > 0)
+        p->len += (size_t)n < sizeof p->text - len ? (size_t)n : sizeof p->text - len - 1;
+    return len;
+}
+
+static void path_pop(SchemaPath *p, size_t len) {
+    p->len = len;
+    p->text[len] = '\0';
+}
+
+static const char *path_text(SchemaPath *p) {
+    return p->len ? p->text : "/";
+}
+
+/* Grows one of the schema's arrays to hold another element */
+static int sc_grow(void **array, int n, int *a, size_t size) {
+    if(n < *a)
+        return 1;
+    int na = *a ? *a << 1 : 8;
+    void *r = realloc(*array, na * size);
+    if(!r)
+        return 0;
+    *array = r;
+    *a = na;
+    return 1;
+}
+
+static int sc_type_bits(const char *name) {
+    if(!strcmp(name, "object")) return 1 << j_object;
+    if(!strcmp(name, "array")) return 1 << j_array;
+    if(!strcmp(name, "string")) return 1 << j_string;
+    if(!strcmp(name, "number")) return 1 << j_number;
+    if(!strcmp(name, "integer")) return SCHEMA_INTEGER;
+    if(!strcmp(name, "boolean")) return (1 << j_true) | (1 << j_false);
+    if(!strcmp(name, "null")) return 1 << j_null;
+    return 0;
+}
+
+static int prop_cmp(const void *a, const void *b) {
+    unsigned int ha = ((const SchemaProp *)a)->hash, hb = ((const SchemaProp *)b)->hash;
+    return ha < hb ? -1 : ha > hb;
+}
+
+static int sc_compile(JSON_Schema *s, JSON *schema);
+
+static int sc_add_prop(JSON_Schema *s, const char *key) {
+    SchemaProp *p;
+    if(!sc_grow((void **)&s->props, s->nprops, &s->aprops, sizeof *s->props))
+        return -1;
+    p = &s->props[s->nprops];
+    if(!(p->key = malloc(strlen(key) + 1)))
+        return -1;
+    strcpy(p->key, key);
+    p->hash = hash(key);
+    p->node = -1;
+    p->required = 0;
+    return s->nprops++;
+}
+
+/* Compiles `schema` into a new node, returning its index or -1 on error */
+static int sc_compile(JSON_Schema *s, JSON *schema) {
+    SchemaNode n;
+    JSON *v;
+    int i, idx;
+
+    if(!json_is_object(schema)) {
+        json_error("schema: a schema must be an object");
+        return -1;
+    }
+
+    n.types = 0;
+    n.has_min = n.has_max = 0;
+    n.min = n.max = 0.0;
+    n.max_length = -1;
+    n.items = -1;
+    n.props = s->nprops;
+    n.nprops = 0;
+    n.nrequired = 0;
+    n.enums = s->nenums;
+    n.nenums = 0;
+
+    if((v = json_obj_get(schema, "type"))) {
+        if(json_is_string(v)) {
+            n.types = sc_type_bits(json_as_string(v));
+        } else if(json_is_array(v)) {
+            for(i = 0; i < json_array_len(v); i++) {
+                const char *t = json_array_get_string(v, i);
+                int bits = t ? sc_type_bits(t) : 0;
+                if(!bits) {
+                    n.types = 0;
+                    break;
+                }
+                n.types |= bits;
+            }
+        }
+        if(!n.types) {
+            json_error("schema: bad \"type\"");
+            return -1;
+        }
+    }
+    if((v = json_obj_get(schema, "minimum"))) {
+        if(!json_is_number(v)) {
+            json_error("schema: \"minimum\" must be a number");
+            return -1;
+        }
+        n.has_min = 1;
+        n.min = json_as_number(v);
+    }
+    if((v = json_obj_get(schema, "maximum"))) {
+        if(!json_is_number(v)) {
+            json_error("schema: \"maximum\" must be a number");
+            return -1;
+        }
+        n.has_max = 1;
+        n.max = json_as_number(v);
+    }
+    if((v = json_obj_get(schema, "maxLength"))) {
+        if(!json_is_number(v) || json_as_number(v) < 0) {
+            json_error("schema: \"maxLength\" must be a non-negative number");
+            return -1;
+        }
+        n.max_length = (long)json_as_number(v);
+    }
+    if((v = json_obj_get(schema, "enum"))) {
+        if(!json_is_array(v)) {
+            json_error("schema: \"enum\" must be an array");
+            return -1;
+        }
+        for(i = 0; i < json_array_len(v); i++) {
+            JSON *e = json_array_get(v, i);
+            if(!e || json_is_object(e) || json_is_array(e)) {
+                json_error("schema: only strings, numbers, booleans and null are supported in \"enum\"");
+                return -1;
+            }
+            if(!sc_grow((void **)&s->enums, s->nenums, &s->aenums, sizeof *s->enums)) {
+                json_error("out of memory");
+                return -1;
+            }
+            s->enums[s->nenums++] = json_retain(e);
+            n.nenums++;
+        }
+    }
+
+    /* The properties and required keys are added before compiling the
+    subschemas, so that they stay contiguous */
+    JSON *properties = json_obj_get(schema, "properties");
+    if(properties) {
+        const char *key;
+        if(!json_is_object(properties)) {
+            json_error("schema: \"properties\" must be an object");
+            return -1;
+        }
+        for(key = json_obj_next(properties, NULL); key; key = json_obj_next(properties, key)) {
+            if(sc_add_prop(s, key) < 0) {
+                json_error("out of memory");
+                return -1;
+            }
+            n.nprops++;
+        }
+    }
+    if((v = json_obj_get(schema, "required"))) {
+        if(!json_is_array(v)) {
+            json_error("schema: \"required\" must be an array");
+            return -1;
+        }
+        for(i = 0; i < json_array_len(v); i++) {
+            const char *key = json_array_get_string(v, i);
+            int j;
+            if(!key) {
+                json_error("schema: \"required\" must contain strings");
+                return -1;
+            }
+            for(j = n.props; j < n.props + n.nprops; j++)
+                if(!strcmp(s->props[j].key, key))
+                    break;
+            if(j == n.props + n.nprops) {
+                if(sc_add_prop(s, key) < 0) {
+                    json_error("out of memory");
+                    return -1;
+                }
+                n.nprops++;
+            }
+            if(!s->props[j].required) {
+                s->props[j].required = 1;
+                n.nrequired++;
+            }
+        }
+    }
+
+    /* Reserve this node's index before its subschemas */
+    if(!sc_grow((void **)&s->nodes, s->nnodes, &s->anodes, sizeof *s->nodes)) {
+        json_error("out of memory");
+        return -1;
+    }
+    idx = s->nnodes++;
+
+    for(i = n.props; properties && i < n.props + n.nprops; i++) {
+        JSON *sub = json_obj_get(properties, s->props[i].key);
+        int node;
+        if(!sub)
+            continue;
+        /* Compiling `sub` may move `s->props` */
+        if((node = sc_compile(s, sub)) < 0)
+            return -1;
+        s->props[i].node = node;
+    }
+    qsort(s->props + n.props, n.nprops, sizeof *s->props, prop_cmp);
+
+    if((v = json_obj_get(schema, "items")) && (n.items = sc_compile(s, v)) < 0)
+        return -1;
+
+    s->nodes[idx] = n;
+    return idx;
+}
+
+JSON_Schema *json_schema_compile(JSON *schema) {
+    JSON_Schema *s = calloc(1, sizeof *s);
+    if(!s) {
+        json_error("out of memory");
+        return NULL;
+    }
+    if(sc_compile(s, schema) < 0) {
+        json_schema_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void json_schema_free(JSON_Schema *s) {
+    int i;
+    if(!s)
+        return;
+    for(i = 0; i < s->nprops; i++)
+        free(s->props[i].key);
+    for(i = 0; i < s->nenums; i++)
+        json_release(s->enums[i]);
+    free(s->props);
+    free(s->enums);
+    free(s->nodes);
+    free(s);
+}
+
+/* Finds the property `key` with hash `h` in the properties of `n`; -1 if there is none */
+static int sc_find_prop(JSON_Schema *s, SchemaNode *n, const char *key, unsigned int h) {
+    int lo = n->props, hi = n->props + n->nprops;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(s->props[mid].hash < h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for(; lo < n->props + n->nprops && s->props[lo].hash == h; lo++)
+        if(!strcmp(s->props[lo].key, key))
+            return lo;
+    return -1;
+}
+
+/* Checks the type of a value and, if it is a scalar, the constraints on
+it. Only the argument for the value's type is used. Returns NULL if the
+value is valid, or a description of the problem */
+static const char *sc_check(JSON_Schema *s, SchemaNode *n, JSON_Type type, double number, int integral, const char *string) {
+    int i;
+    if(n->types && !(n->types & (1 << type))
+            && !(type == j_number && integral && (n->types & SCHEMA_INTEGER)))
+        return "wrong type";
+    if(type == j_number) {
+        if(n->has_min && number < n->min)
+            return "number is less than the minimum";
+        if(n->has_max && number > n->max)
+            return "number is greater than the maximum";
+    } else if(type == j_string && n->max_length >= 0) {
+        /* The length is counted in code points */
+        const char *c;
+        long len = 0;
+        for(c = string; *c; c++)
+            if(((unsigned char)*c & 0xC0) != 0x80)
+                len++;
+        if(len > n->max_length)
+            return "string is longer than maxLength";
+    }
+    if(n->nenums) {
+        for(i = n->enums; i < n->enums + n->nenums; i++) {
+            JSON *e = s->enums[i];
+            if(e->type != type)
+                continue;
+            if(type == j_number ? json_as_number(e) == number
+                    : type != j_string || !strcmp(e->value.string, string))
+                return NULL;
+        }
+        return "value is not in the enum";
+    }
+    return NULL;
+}
+
+static int sc_validate(JSON_Schema *s, int idx, JSON *j, SchemaPath *path) {
+    SchemaNode *n;
+    const char *err;
+    size_t i;
+
+    if(idx < 0)
+        return 1;
+    n = &s->nodes[idx];
+    if(!j)
+        j = json_null();
+
+    if(j->type == j_number)
+        err = sc_check(s, n, j_number, json_as_number(j), j->is_int || floor(j->value.number) == j->value.number, NULL);
+    else
+        err = sc_check(s, n, j->type, 0.0, 0, j->type == j_string ? j->value.string : NULL);
+    if(err) {
+        json_error("schema: %s: %s", path_text(path), err);
+        return 0;
+    }
+
+    if(j->type == j_object) {
+        HashTable *h = j->value.object;
+        for(i = n->props; i < n->props + n->nprops; i++) {
+            SchemaProp *p = &s->props[i];
+            JSON *v = ht_get_hashed(h, p->key, p->hash);
+            size_t len;
+            int ok;
+            if(!v) {
+                if(p->required) {
+                    json_error("schema: %s: missing required property \"%s\"", path_text(path), p->key);
+                    return 0;
+                }
+                continue;
+            }
+            len = path_push(path, p->key, 0);
+            ok = sc_validate(s, p->node, v, path);
+            path_pop(path, len);
+            if(!ok)
+                return 0;
+        }
+    } else if(j->type == j_array && n->items >= 0) {
+        Array *a = j->value.array;
+        for(i = 0; i < a->n; i++) {
+            size_t len = path_push(path, NULL, (int)i);
+            int ok;
+            if(!a->packed) {
+                ok = sc_validate(s, n->items, a->elements[i], path);
+            } else {
+                /* packed numbers */
+                double d = a->numbers[i];
+                err = sc_check(s, &s->nodes[n->items], j_number, d, a->ints || floor(d) == d, NULL);
+                if(err)
+                    json_error("schema: %s: %s", path_text(path), err);
+                ok = !err;
+            }
+            path_pop(path, len);
+            if(!ok)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+int json_schema_validate(JSON_Schema *s, JSON *j) {
+    SchemaPath path;
+    path_pop(&path, 0);
+    return sc_validate(s, 0, j, &path);
+}
+
+/* Validates the value at the current symbol while parsing it. `seen` has
+a flag for every property in the schema. Like json_validate(), it rejects
+values nested more than JSON_MAX_DEPTH deep */
+static int sc_validate_stream(JSON_Schema *s, int idx, ParserContext *pc, char *seen, SchemaPath *path, int depth) {
+    SchemaNode *n = idx >= 0 ? &s->nodes[idx] : NULL;
+    const char *err = NULL;
+    int i, count = 0;
+
+    if((pc->sym == '{' || pc->sym == '[') && depth >= JSON_MAX_DEPTH) {
+        json_error("line %d: too many nested objects and arrays", pc->lineno);
+        return 0;
+    }
+
+    switch(pc->sym) {
+        case '{':
+            if(n) {
+                err = sc_check(s, n, j_object, 0.0, 0, NULL);
+                if(err)
+                    break;
+                memset(seen + n->props, 0, n->nprops);
+            }
+            getsym(pc);
+            if(pc->sym != '}') {
+                do {
+                    size_t len;
+                    int p = -1, ok;
+                    if(pc->sym != P_STRING) {
+                        if(pc->sym == P_ERROR)
+                            json_error("line %d: %s", pc->lineno, pc->e.buffer);
+                        else
+                            json_error("line %d: string expected", pc->lineno);
+                        return 0;
+                    }
+                    if(n && (p = sc_find_prop(s, n, pc->e.buffer, hash(pc->e.buffer))) >= 0
+                            && !seen[p]) {
+                        seen[p] = 1;
+                        count += s->props[p].required;
+                    }
+                    len = path_push(path, pc->e.buffer, 0);
+                    if(getsym(pc) != ':') {
+                        json_error("line %d: ':' expected", pc->lineno);
+                        return 0;
+                    }
+                    getsym(pc);
+                    ok = sc_validate_stream(s, p >= 0 ? s->props[p].node : -1, pc, seen, path, depth + 1);
+                    path_pop(path, len);
+                    if(!ok)
+                        return 0;
+                } while(pc->sym == ',' && (getsym(pc), 1));
+            }
+            if(pc->sym != '}') {
+                json_error("line %d: '}' expected", pc->lineno);
+                return 0;
+            }
+            if(n && count < n->nrequired) {
+                for(i = n->props; i < n->props + n->nprops; i++)
+                    if(s->props[i].required && !seen[i])
+                        break;
+                json_error("line %d: schema: %s: missing required property \"%s\"", pc->lineno, path_text(path), s->props[i].key);
+                return 0;
+            }
+            break;
+        case '[':
+            if(n && (err = sc_check(s, n, j_array, 0.0, 0, NULL)))
+                break;
+            getsym(pc);
+            if(pc->sym != ']') {
+                do {
+                    size_t len = path_push(path, NULL, count++);
+                    int ok = sc_validate_stream(s, n ? n->items : -1, pc, seen, path, depth + 1);
+                    path_pop(path, len);
+                    if(!ok)
+                        return 0;
+                } while(pc->sym == ',' && (getsym(pc), 1));
+            }
+            if(pc->sym != ']') {
+                json_error("line %d: ']' expected", pc->lineno);
+                return 0;
+            }
+            break;
+        case P_NUMBER:
+            if(n) {
+                double d = pc->is_int ? (double)pc->integer : atof(pc->e.buffer);
+                err = sc_check(s, n, j_number, d, pc->is_int || floor(d) == d, NULL);
+            }
+            break;
+        case P_STRING: if(n) err = sc_check(s, n, j_string, 0.0, 0, pc->e.buffer); break;
+        case P_TRUE: if(n) err = sc_check(s, n, j_true, 0.0, 0, NULL); break;
+        case P_FALSE: if(n) err = sc_check(s, n, j_false, 0.0, 0, NULL); break;
+        case P_NULL: if(n) err = sc_check(s, n, j_null, 0.0, 0, NULL); break;
+        case P_ERROR:
+            json_error("line %d: %s", pc->lineno, pc->e.buffer);
+            return 0;
+        default:
+            json_error("line %d: value expected", pc->lineno);
+            return 0;
+    }
+    if(err) {
+        json_error("line %d: schema: %s: %s", pc->lineno, path_text(path), err);
+        return 0;
+    }
+    getsym(pc);
+    if(pc->sym == P_ERROR) {
+        json_error("line %d: %s", pc->lineno, pc->e.buffer);
+        return 0;
+    }
+    return 1;
+}
+
+int json_schema_validate_text(JSON_Schema *s, const char *text) {
+    ParserContext pc;
+    SchemaPath path;
+    char *seen;
+    int ok = 0;
+
+    if(strlen(text) >= 3 && !memcmp("\xEF\xBB\xBF", text, 3))
+        text += 3;
+
+    if(!(seen = malloc(s->nprops + 1))) {
+        json_error("out of memory");
+        return 0;
+    }
+    if(!init_parser(&pc, text, strlen(text))) {
+        free(seen);
+        return 0;
+    }
+    path_pop(&path, 0);
+    if(sc_validate_stream(s, 0, &pc, seen, &path, 0)) {
+        if(pc.sym == P_END)
+            ok = 1;
+        else
+            json_error("line %d: unexpected content after the value", pc.lineno);
+    }
+    destroy_parser(&pc);
+    free(seen);
+    return ok;
+}
@@ -22,6 +22,9 @@
 
 #ifndef JSON_H
 #define JSON_H
+
+#include <stdio.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C"
 {
@@ -83,7 +86,8 @@ extern int (*json_error)(const char *fmt, ...);
  * The return value is expected to be allocated on the heap, and `free()`
  * will be called on it.
  *
- * The default uses `fopen()` and `fread()`
+ * The default uses `fopen()` and `fread()`, reading the file in chunks
+ * so that it also works on pipes.
  */
 extern char *(*json_readfile)(const char *fname);
 
@@ -105,6 +109,41 @@ JSON *json_read(const char *filename);
  */
 JSON *json_parse(const char *text);
 
+/**
+ * ### `JSON *json_parse_projection(const char *text, const char *paths[], int n);`
+ *
+ * Parses a JSON object in `text`, but only builds the members selected by
+ * the `n` dotted `paths`, like `"user.name"`. The result is an object
+ * containing just the selected values under their original keys, with
+ * the objects leading to them; paths that are not found are left out.
+ *
+ * Everything else is skipped without copying, unescaping or allocating
+ * anything, which is much faster than parsing the whole text and then
+ * looking up the values when only a few of them are needed. Skipped values
+ * are tokenized with the same rules as `json_parse()`, but their nested
+ * objects and arrays are only matched by bracket.
+ *
+ * Paths can only select object members; a path that continues into a
+ * value that is not an object selects nothing.
+ */
+JSON *json_parse_projection(const char *text, const char *paths[], int n);
+
+/**
+ * ### `int json_validate(const char *text, size_t len, size_t *err_offset);`
+ *
+ * Checks whether the `len` bytes at `text` are a single valid JSON value,
+ * following the same grammar as `json_parse()` (including comments and a
+ * leading BOM), without building the value or allocating any memory.
+ * `text` need not be null-terminated. Trailing content after the value,
+ * other than whitespace and comments, is an error.
+ *
+ * Objects and arrays may be nested at most `JSON_MAX_DEPTH` levels deep.
+ *
+ * It returns 1 if the text is valid. Otherwise it returns 0 and, if
+ * `err_offset` is not `NULL`, stores the offset of the error in it.
+ */
+int json_validate(const char *text, size_t len, size_t *err_offset);
+
 /**
  * ### `JSON *json_retain(JSON *j);`
  *
@@ -135,6 +174,44 @@ char *json_serialize(JSON *j);
  */
 char *json_pretty(JSON *j);
 
+/**
+ * ### `char *json_escape(const char *str);`
+ *
+ * Returns `str` as a quoted JSON string, with the same escapes as
+ * `json_serialize()`, in a heap-allocated buffer.
+ */
+char *json_escape(const char *str);
+
+/**
+ * ### `int json_reformat(FILE *in, FILE *out, int mode);`
+ *
+ * Reformats the JSON text read from `in` to `out` without parsing it
+ * into a tree. `mode` is either
+ *
+ * * `JSON_REFORMAT_MINIFY` - removes all whitespace and comments, or
+ * * `JSON_REFORMAT_PRETTY` - indents it the same way as `json_pretty()`.
+ *
+ * Strings, numbers and keywords are copied verbatim, and memory use is
+ * constant regardless of the size of the input. Each top-level value is
+ * followed by a newline, so a stream of values (like a [JSON Lines][jsonl]
+ * file) gives one minified value per line.
+ *
+ * It checks the structure of the text: brackets must match, values
+ * must be separated by commas, keys must be strings followed by colons,
+ * keywords must be `true`, `false` or `null`, and strings and comments
+ * must be terminated. Objects and arrays may be nested at most
+ * `JSON_MAX_DEPTH` levels deep. The contents of strings and numbers are
+ * not checked.
+ *
+ * It returns 1 on success. On error it calls `json_error()` and returns 0.
+ *
+ * [jsonl]: https://jsonlines.org/
+ */
+#define JSON_REFORMAT_MINIFY    0
+#define JSON_REFORMAT_PRETTY    1
+
+int json_reformat(FILE *in, FILE *out, int mode);
+
 /**
  * ### `JSON *json_new_object()`
  *
@@ -163,6 +240,18 @@ JSON *json_new_string(const char *text);
  */
 JSON *json_new_number(double n);
 
+/**
+ * ### `JSON *json_new_int64(int64_t n)`
+ *
+ * Creates a new JSON number entity that holds the integer `n` exactly.
+ *
+ * The parser also creates numbers like these for numeric values without a
+ * fraction or exponent that fit in 64 bits, so that IDs and counters above
+ * 2<sup>53</sup> are not corrupted by being converted to `double`.
+ * They are serialized without a fraction or exponent.
+ */
+JSON *json_new_int64(int64_t n);
+
 /**
  * ### `JSON *json_null()`
  *
@@ -259,6 +348,14 @@ int json_is_falsey(JSON *j);
  */
 int json_is_number(JSON *j);
 
+/**
+ * ### `int json_is_integer(JSON *j)`
+ *
+ * Returns non-zero if `j` is a numeric JSON value that is
+ * stored as a 64-bit integer. See `json_new_int64()`.
+ */
+int json_is_integer(JSON *j);
+
 /**
  * ### `int json_is_string(JSON *j)`
  *
@@ -287,6 +384,17 @@ int json_is_array(JSON *j);
  */
 double json_as_number(JSON *j);
 
+/**
+ * ### `int64_t json_as_int64(JSON *j)`
+ *
+ * Returns the JSON entity `j` as a 64-bit integer.
+ *
+ * Numbers that are stored as integers are returned exactly; other numbers
+ * are truncated, and 0 is returned if they are out of range or `j` is not
+ * a number.
+ */
+int64_t json_as_int64(JSON *j);
+
 /**
  * ### `const char *json_as_string(JSON *j)`
  *
@@ -449,6 +557,12 @@ JSON *json_array_reserve(JSON *array, unsigned int n);
  * ### `JSON *json_array_get(JSON *array, int n)`
  *
  * Retrieves the `n`'th element in the JSON array `array`.
+ *
+ * Arrays that contain only numbers are stored packed as an array of
+ * `double`s, so the first call for an element of such an array allocates
+ * a `JSON` entity for it, which the array keeps for later calls. The
+ * array stays packed. Use `json_array_get_number()` or
+ * `json_array_numbers()` to avoid the allocations.
  */
 JSON *json_array_get(JSON *array, int n);
 
@@ -459,6 +573,20 @@ JSON *json_array_get(JSON *array, int n);
  */
 double json_array_get_number(JSON *array, int n);
 
+/**
+ * ### `const double *json_array_numbers(JSON *array)`
+ *
+ * Returns the values of a JSON array that contains only numbers, as
+ * an array of `json_array_len()` `double`s, without unpacking them.
+ *
+ * It returns `NULL` if the array is empty or not packed. An array is not
+ * packed if it contains any other values, if it contains integers too
+ * large for a `double` to hold exactly, or once `json_array_set()` or
+ * `json_array_add()` has been called on it.
+ * The returned pointer is only valid until the array is modified.
+ */
+const double *json_array_numbers(JSON *array);
+
 /**
  * ### `const char *json_array_get_string(JSON *array, int n)`
  *
@@ -475,6 +603,50 @@ const char *json_array_get_string(JSON *array, int n);
  */
 JSON *json_array_set(JSON *array, int n, JSON *v);
 
+/**
+ * ### `JSON *json_obj_set_cow(JSON *obj, char *k, JSON *v)`
+ *
+ * Copy-on-write version of `json_obj_set()`: if `obj` is shared (its
+ * reference count is more than 1), the value is set in a shallow copy of
+ * `obj` that shares all its members with the original, and the caller's
+ * reference to `obj` is released. Otherwise `obj` is modified in place.
+ *
+ * It returns the modified object, so it is meant to be used like this:
+ *
+ *     doc = json_obj_set_cow(doc, "key", json_new_string("value"));
+ */
+JSON *json_obj_set_cow(JSON *obj, char *k, JSON *v);
+
+/**
+ * ### `JSON *json_array_set_cow(JSON *array, int n, JSON *v)`
+ *
+ * Copy-on-write version of `json_array_set()`, like `json_obj_set_cow()`.
+ */
+JSON *json_array_set_cow(JSON *array, int n, JSON *v);
+
+/**
+ * ### `JSON *json_set_path_cow(JSON *root, const char *path, JSON *v)`
+ *
+ * Sets the value at the dotted `path` (like `"user.addresses.0.city"`)
+ * under `root` to `v`, copying only the shared objects and arrays on the
+ * way from `root` to the value, so that a shared template document can be
+ * modified in O(depth) rather than by copying all of it.
+ *
+ * Path components are object keys, or indices into arrays. Missing
+ * objects along the path are created. If an index is not a valid index
+ * of its array, `json_error()` is called, `v` is released and `root` is
+ * returned unmodified.
+ *
+ * As with `json_obj_set_cow()`, the caller's reference to `root` is
+ * replaced by the return value.
+ *
+ * Several threads can derive their own documents from the same template
+ * this way, each starting with its own reference to it from
+ * `json_retain()`, since the shared values are never modified. This
+ * relies on atomic reference counts (see `JSON_THREADS` in **json.c**).
+ */
+JSON *json_set_path_cow(JSON *root, const char *path, JSON *v);
+
 /**
  * ### `JSON *json_array_add(JSON *array, JSON *value)`
  *
@@ -502,6 +674,74 @@ JSON *json_array_add_number(JSON *array, double number);
  */
 JSON *json_array_add_string(JSON *array, const char *str);
 
+/**
+ * ## Schemas
+ *
+ * A subset of [JSON Schema][schema] can be compiled into a flat program
+ * that validates documents in a single pass. These keywords are supported;
+ * others are ignored:
+ *
+ * * `type` - a type name or an array of them: `"object"`, `"array"`,
+ *   `"string"`, `"number"`, `"integer"`, `"boolean"` or `"null"`
+ * * `properties` - an object with the schemas of the members of an object
+ * * `required` - an array of the keys that an object must have
+ * * `items` - the schema of all the elements of an array
+ * * `enum` - an array of the allowed values, which must be strings,
+ *   numbers, booleans or `null`
+ * * `minimum` and `maximum` - the range of a number
+ * * `maxLength` - the maximum length of a string, in code points
+ *
+ * The keys of the properties are hashed when the schema is compiled.
+ *
+ * [schema]: https://json-schema.org/
+ */
+
+/**
+ * ### `typedef struct json_schema JSON_Schema;`
+ *
+ * A compiled schema.
+ */
+typedef struct json_schema JSON_Schema;
+
+/**
+ * ### `JSON_Schema *json_schema_compile(JSON *schema)`
+ *
+ * Compiles the JSON Schema in `schema`.
+ *
+ * It returns `NULL` and calls `json_error()` if the schema is invalid.
+ */
+JSON_Schema *json_schema_compile(JSON *schema);
+
+/**
+ * ### `void json_schema_free(JSON_Schema *s)`
+ *
+ * Frees a compiled schema.
+ */
+void json_schema_free(JSON_Schema *s);
+
+/**
+ * ### `int json_schema_validate(JSON_Schema *s, JSON *j)`
+ *
+ * Validates the JSON entity `j` against the schema `s`.
+ *
+ * It returns 1 if `j` is valid. Otherwise it calls `json_error()` with
+ * the location of the first problem (as a JSON pointer) and returns 0.
+ */
+int json_schema_validate(JSON_Schema *s, JSON *j);
+
+/**
+ * ### `int json_schema_validate_text(JSON_Schema *s, const char *text)`
+ *
+ * Validates the JSON text `text` against the schema `s` while tokenizing
+ * it, without building a `JSON` tree.
+ *
+ * It returns 1 if `text` is valid, and 0 otherwise, like
+ * `json_schema_validate()`. Syntax errors are also reported, and so are
+ * objects and arrays nested more than `JSON_MAX_DEPTH` levels deep, as in
+ * `json_validate()`.
+ */
+int json_schema_validate_text(JSON_Schema *s, const char *text);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
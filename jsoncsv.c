@@ -0,0 +1,319 @@
+/*
+ * Streaming converters between JSON Lines and CSV files.
+ * See jsoncsv.h for details.
+ *
+ * This is free and unencumbered software released into the public domain.
+ * http://unlicense.org/
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "json.h"
+#include "jsoncsv.h"
+
+/* This file's own configuration of the CSV reader, for real world records.
+The context is allocated on the heap because of the size of its buffer */
+#define CSV_STATIC
+#define CSV_IMPLEMENTATION
+#define CSV_BUFFER_SIZE         (1 << 20)
+#define CSV_READ_BUFFER_SIZE    8192
+#define CSV_MAX_FIELDS          256
+#include "csvstrm.h"
+
+/* Reads a line of any length into `*buf`, which grows as needed.
+Returns NULL at the end of the file */
+static char *read_line(FILE *f, char **buf, size_t *a) {
+    size_t n = 0;
+    for(;;) {
+        if(*a - n < 2) {
+            size_t na = *a ? *a << 1 : 1024;
+            char *nb = realloc(*buf, na);
+            if(!nb) {
+                json_error("out of memory");
+                return NULL;
+            }
+            *buf = nb;
+            *a = na;
+        }
+        if(!fgets(*buf + n, (int)(*a - n), f))
+            return n ? *buf : NULL;
+        n += strlen(*buf + n);
+        if(n && (*buf)[n - 1] == '\n')
+            return *buf;
+    }
+}
+
+static int is_blank(const char *s) {
+    while(isspace((unsigned char)*s))
+        s++;
+    return !*s;
+}
+
+/* Retrieves the member at the dotted `path` of `j`. A backslash makes the
+next character part of the key, so `a\.b` is the key "a.b".
+`seg` has room for the path */
+static JSON *get_path(JSON *j, const char *path, char *seg) {
+    while(j && json_is_object(j)) {
+        char *p = seg;
+        while(*path && *path != '.') {
+            if(*path == '\\' && path[1])
+                path++;
+            *p++ = *path++;
+        }
+        *p = '\0';
+        j = json_obj_get(j, seg);
+        if(!*path++)
+            return j;
+    }
+    return NULL;
+}
+
+/* Copies `path` without the backslashes that escape its characters */
+static char *unescape_path(const char *path) {
+    char *s = malloc(strlen(path) + 1), *p = s;
+    if(!s)
+        return NULL;
+    for(; *path; path++) {
+        if(*path == '\\' && path[1])
+            path++;
+        *p++ = *path;
+    }
+    *p = '\0';
+    return s;
+}
+
+int json_lines_to_csv(FILE *in, FILE *out, const char *header[], int n) {
+    char *line = NULL, *seg = NULL;
+    size_t a = 0, maxlen = 0;
+    char **keys = NULL, **text = NULL;
+    const char **fields = NULL;
+    JSON *j = NULL;
+    int i, lineno = 0, ok = 0, literal = !header, escaped = 0;
+
+    if(!header) {
+        /* Take the header from the keys of the first object */
+        const char *key;
+        do {
+            if(!read_line(in, &line, &a)) {
+                /* nothing to convert */
+                free(line);
+                return !ferror(in);
+            }
+            lineno++;
+        } while(is_blank(line));
+        if(!(j = json_parse(line)))
+            goto error;
+        if(!json_is_object(j)) {
+            json_error("line %d: object expected", lineno);
+            goto error;
+        }
+        for(n = 0, key = json_obj_next(j, NULL); key; key = json_obj_next(j, key))
+            n++;
+        if(!(keys = calloc(n + 1, sizeof *keys)))
+            goto nomem;
+        for(i = 0, key = json_obj_next(j, NULL); key; key = json_obj_next(j, key), i++)
+            if(!(keys[i] = strdup(key)))
+                goto nomem;
+        header = (const char **)keys;
+    } else {
+        /* The header record has the names without escapes */
+        if(!(keys = calloc(n + 1, sizeof *keys)))
+            goto nomem;
+        for(i = 0; i < n; i++) {
+            if(!(keys[i] = unescape_path(header[i])))
+                goto nomem;
+            if(strchr(header[i], '\\'))
+                escaped = 1;
+        }
+    }
+
+    for(i = 0; i < n; i++)
+        if(strlen(header[i]) > maxlen)
+            maxlen = strlen(header[i]);
+    fields = calloc(n + 1, sizeof *fields);
+    text = calloc(n + 1, sizeof *text);
+    seg = malloc(maxlen + 1);
+    if(!fields || !text || !seg)
+        goto nomem;
+
+    if(!csv_write_record(out, (const char **)keys, n))
+        goto ioerror;
+
+    for(;;) {
+        if(!j) {
+            if(!read_line(in, &line, &a))
+                break;
+            lineno++;
+            if(is_blank(line))
+                continue;
+            /* Projections don't know about escaped or literal keys */
+            if(!(j = literal || escaped ? json_parse(line) : json_parse_projection(line, header, n))) {
+                json_error("line %d: unable to convert the line", lineno);
+                goto error;
+            }
+            if(!json_is_object(j)) {
+                json_error("line %d: object expected", lineno);
+                goto error;
+            }
+        }
+        for(i = 0; i < n; i++) {
+            JSON *v = literal ? json_obj_get(j, header[i]) : get_path(j, header[i], seg);
+            if(!v || json_is_null(v))
+                fields[i] = "";
+            else if(json_is_string(v))
+                fields[i] = json_as_string(v);
+            else if(!(fields[i] = text[i] = json_serialize(v)))
+                goto nomem;
+        }
+        if(!csv_write_record(out, fields, n))
+            goto ioerror;
+        for(i = 0; i < n; i++) {
+            free(text[i]);
+            text[i] = NULL;
+        }
+        json_release(j);
+        j = NULL;
+    }
+    if(ferror(in))
+        goto ioerror;
+
+    ok = 1;
+    goto error;
+ioerror:
+    json_error("unable to convert JSON to CSV: %s", strerror(errno));
+    goto error;
+nomem:
+    json_error("out of memory");
+error:
+    if(keys) {
+        for(i = 0; i < n; i++)
+            free(keys[i]);
+        free(keys);
+    }
+    if(text) {
+        for(i = 0; i < n; i++)
+            free(text[i]);
+        free(text);
+    }
+    free(fields);
+    free(seg);
+    free(line);
+    json_release(j);
+    return ok;
+}
+
+/* Checks that `s` follows the JSON number grammar */
+static int is_json_number(const char *s) {
+    if(*s == '-')
+        s++;
+    if(*s == '0')
+        s++;
+    else if(isdigit((unsigned char)*s))
+        while(isdigit((unsigned char)*s))
+            s++;
+    else
+        return 0;
+    if(*s == '.') {
+        if(!isdigit((unsigned char)*++s))
+            return 0;
+        while(isdigit((unsigned char)*s))
+            s++;
+    }
+    if(*s == 'e' || *s == 'E') {
+        s++;
+        if(*s == '+' || *s == '-')
+            s++;
+        if(!isdigit((unsigned char)*s))
+            return 0;
+        while(isdigit((unsigned char)*s))
+            s++;
+    }
+    return !*s;
+}
+
+/* Writes `s` to `f` as a JSON string */
+static int write_string(FILE *f, const char *s) {
+    char *t = json_escape(s);
+    if(!t)
+        return 0;
+    fputs(t, f);
+    free(t);
+    return 1;
+}
+
+int csv_to_json_lines(FILE *in, FILE *out, int flags) {
+    CsvContext *csv;
+    char **keys = NULL;
+    int i, n = 0, record = 0, ok = 0, first;
+
+    if(!(csv = malloc(sizeof *csv)))
+        goto nomem;
+    csv_context_file(csv, in);
+    while(csv_read_record(csv)) {
+        record++;
+        if(csv_get_error(csv) == CSV_ERR_BUFFER) {
+            json_error("record %d: record is longer than %d bytes", record, CSV_BUFFER_SIZE);
+            goto error;
+        } else if(csv_get_error(csv) != CSV_OK) {
+            json_error("record %d: CSV error %d", record, csv_get_error(csv));
+            goto error;
+        }
+        if(csv_count(csv) == 1 && !csv_field(csv, 0)[0])
+            continue;
+        if(!keys) {
+            n = csv_count(csv);
+            if(!(keys = calloc(n, sizeof *keys)))
+                goto nomem;
+            /* The keys are kept as JSON strings, ready to be written */
+            for(i = 0; i < n; i++)
+                if(!(keys[i] = json_escape(csv_field(csv, i))))
+                    goto nomem;
+            /* If a key is repeated, its last field is the one that is kept */
+            for(i = 0; i < n; i++) {
+                int k;
+                for(k = i + 1; k < n && strcmp(keys[i], keys[k]); k++);
+                if(k < n) {
+                    free(keys[i]);
+                    keys[i] = NULL;
+                }
+            }
+            continue;
+        }
+        /* The object is written directly so that numbers keep their digits */
+        fputc('{', out);
+        for(i = 0, first = 1; i < n && i < csv_count(csv); i++) {
+            const char *field = csv_field(csv, i);
+            if(!keys[i])
+                continue;
+            if(!first)
+                fputc(',', out);
+            first = 0;
+            fputs(keys[i], out);
+            fputc(':', out);
+            if((flags & JSONCSV_NUMBERS) && is_json_number(field))
+                fputs(field, out);
+            else if(!write_string(out, field))
+                goto error;
+        }
+        fputs("}\n", out);
+        if(ferror(out)) {
+            json_error("unable to convert CSV to JSON: %s", strerror(errno));
+            goto error;
+        }
+    }
+    ok = 1;
+    goto error;
+nomem:
+    json_error("out of memory");
+error:
+    if(keys) {
+        for(i = 0; i < n; i++)
+            free(keys[i]);
+        free(keys);
+    }
+    free(csv);
+    return ok;
+}
@@ -0,0 +1,87 @@
+/**
+ * # `jsoncsv.h`
+ * Streaming converters between [JSON Lines][jsonl] and CSV files.
+ *
+ * The converters process one line or record at a time, so their memory
+ * use does not depend on the size of the files. They use the
+ * JSON parser and serializer in **json.c** and the CSV stream reader in
+ * **csvstrm.h**.
+ *
+ * Each JSON object maps to one CSV record, with the fields in the order
+ * of a header. Errors are reported through `json_error()`.
+ *
+ * ### License
+ *
+ *     Author: Werner Stoop
+ *     This is free and unencumbered software released into the public domain.
+ *     See http://unlicense.org/ for more details.
+ *
+ * [jsonl]: https://jsonlines.org/
+ *
+ * ## API
+ */
+
+#ifndef JSONCSV_H
+#define JSONCSV_H
+
+#include <stdio.h>
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/**
+ * #### `int json_lines_to_csv(FILE *in, FILE *out, const char *header[], int n)`
+ *
+ * Converts the JSON objects read from `in`, one per line, into CSV records
+ * written to `out`, preceded by a header record.
+ *
+ * The `n` names in `header` select the members that become the fields of
+ * each record. Names containing dots select members of nested objects,
+ * like `"address.city"`. A backslash makes the next character part of the
+ * key, so `"a\\.b"` in C selects the member `"a.b"` and not `"b"` inside
+ * `"a"`. The header record contains the names without these backslashes.
+ * Only the selected members of each line are built (see
+ * `json_parse_projection()`), unless the names contain backslashes.
+ *
+ * If `header` is `NULL`, the keys of the object on the first line are
+ * used instead. These keys are taken literally, even if they contain dots.
+ *
+ * Strings are written as is, `null` and missing members as empty fields,
+ * and other values as their JSON text (see `json_serialize()`). Numbers
+ * are written with as many digits as it takes to read them back as the
+ * same `double`.
+ *
+ * Blank lines are skipped. It returns 1 on success and 0 on failure.
+ */
+int json_lines_to_csv(FILE *in, FILE *out, const char *header[], int n);
+
+/**
+ * #### `int csv_to_json_lines(FILE *in, FILE *out, int flags)`
+ *
+ * Converts the CSV records read from `in` into JSON objects written to
+ * `out`, one per line. The first record is the header that contains the
+ * keys of the objects.
+ *
+ * Fields that are missing from a record are left out of its object, and
+ * fields beyond those in the header are ignored.
+ *
+ * `flags` can be 0 or `JSONCSV_NUMBERS`, in which case fields that are
+ * valid JSON numbers are written as numbers rather than strings, with
+ * exactly the digits of the field.
+ *
+ * If the header repeats a key, the last field with that key is used.
+ *
+ * Records may be up to 1MB long.
+ *
+ * Blank lines are skipped. It returns 1 on success and 0 on failure.
+ */
+#define JSONCSV_NUMBERS     0x01
+
+int csv_to_json_lines(FILE *in, FILE *out, int flags);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+} /* extern "C" */
+#endif
+
+#endif /* JSONCSV_H */
@@ -7,10 +7,10 @@
  
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <assert.h>
 
 #include "list.h"
+#include "utils.h"
 
 /*****************************************************************************/
 
@@ -201,10 +201,7 @@ int list_strcmp(void *p, void *q)
 
 int list_stricmp(void *p, void *q)
 {
-	char *s1 = p, *s2 = q;
-	for(;s1[0] && s2[0] && tolower(s1[0]) == tolower(s2[0]); s1++, s2++);
-
-	return tolower(s1[0]) == tolower(s2[0]);
+	return !my_stricmp(p, q);
 }
 
 /*****************************************************************************/
@@ -37,11 +37,24 @@ extern "C" {
  *   library declared `static`. This is useful if you need to
  *   use the libary to parse different
  * * `ST_BUFFER_SIZE` (default: 256) -
- *   Size of the buffer used to store tokens.
- * * `ST_READ_BUFFER_SIZE` (default: 64) -
+ *   Initial size of the buffer that tokens are copied into when they
+ *   need to be transformed (strings containing escape sequences, and
+ *   words in `lowercaseMode`). The buffer grows as needed.
+ * * `ST_READ_BUFFER_SIZE` (default: 4096) -
  *   This controls the size of the second internal buffer that
  *   stores raw bytes as they are read from the input before they're
- *   processed.
+ *   processed. Tokens are scanned directly inside this block, so larger
+ *   values mean fewer calls to the `st_read_data_fun`. If a token does
+ *   not fit in the block, the block is moved to the heap and enlarged
+ *   (see `st_free()`).
+ * * `ST_TRIE_SIZE` (default: 64) -
+ *   The number of nodes in the trie of operators and comment and string
+ *   delimiters that are kept inside the `StrmTok` structure. Larger sets
+ *   of operators move the trie to the heap (see `st_free()`).
+ * * `ST_KEYWORD_TABLE_SIZE` (default: 256) -
+ *   The number of entries of the keyword table of `st_keywords()` that are
+ *   kept inside the `StrmTok` structure. Each keyword takes about 3 entries;
+ *   larger tables are allocated on the heap (see `st_free()`).
  * * `ST_DEFAULT_LOWERCASE_MODE` (default: 0) -
  *   default value for `StrmTok.lowercaseMode`
  * * `ST_DEFAULT_SIGNIFICANT_EOL` (default: 0) -
@@ -64,6 +77,9 @@ extern "C" {
  *   default value for `StrmTok.word_chars`
  * * `ST_DEFAULT_OPERATORS` (default: `NULL`) -
  *   default value for `StrmTok.operators`
+ * * `ST_STATS` (default: `0`) - if non-zero, `StrmTok.stats` counts the
+ *   tokens, block refills, block enlargements, ungets and bytes read, for
+ *   profiling the tokenizer.
  *
  * **Note**: Unless you declare `ST_STATIC`,
  * the buffer sizes _must_ be the same in all files that include **strmtok.h**.
@@ -79,7 +95,15 @@ extern "C" {
 #  endif
 
 #  ifndef ST_READ_BUFFER_SIZE
-#    define ST_READ_BUFFER_SIZE 64
+#    define ST_READ_BUFFER_SIZE 4096
+#  endif
+
+#  ifndef ST_TRIE_SIZE
+#    define ST_TRIE_SIZE 64
+#  endif
+
+#  ifndef ST_KEYWORD_TABLE_SIZE
+#    define ST_KEYWORD_TABLE_SIZE 256
 #  endif
 
 #  ifndef ST_DEFAULT_LOWERCASE_MODE
@@ -126,8 +150,8 @@ extern "C" {
 #    define ST_DEFAULT_OPERATORS NULL
 #  endif
 
-#  ifndef ST_UNGET_COUNT
-#    define ST_UNGET_COUNT 8
+#  ifndef ST_STATS
+#    define ST_STATS 0
 #  endif
 
 #if defined(STRMTOK_TEST)
@@ -147,8 +171,9 @@ extern "C" {
  * the input files. `n` contains the size in bytes of the buffer.
  * `d` is a pointer to some structure where the data is read from.
  *
- * The function should return 0 if it reaches the end of the input data,
- * non-zero otherwise.
+ * The function should return the number of bytes it placed in `b`,
+ * or 0 if it reaches the end of the input data. The buffer does not
+ * need to be null-terminated.
  *
  */
 
@@ -171,6 +196,12 @@ typedef int (*st_read_data_fun)(char *b, int n, void *d);
  *      characters in `StrmTok.word_chars`.
  *  * `ST_STRING` - The token was a quote-delimited string.
  *  * `ST_NUMBER` - The token was a numeric value.
+ *  * `ST_KEYWORD` - The token was a word that matched one of the keywords
+ *      registered through `st_keywords()`. `st_next_token()` returns
+ *      `ST_KEYWORD + i` where `i` is the index of the keyword in the list.
+ *  * `ST_OPERATOR` - The token matched one of the operators registered
+ *      through `st_operators()`. `st_next_token()` returns `ST_OPERATOR + i`
+ *      where `i` is the index of the operator in the list.
  */
 enum st_token {
     ST_ERROR = -1,
@@ -179,6 +210,13 @@ enum st_token {
     ST_WORD,
     ST_STRING,
     ST_NUMBER,
+    ST_KEYWORD = 0x100,
+    ST_OPERATOR = 0x4000
+};
+
+/* Node in the trie of operators and delimiters compiled by `st_configure()` */
+struct st_trie_node {
+    int c, child, sibling, accept;
 };
 
 /**
@@ -214,22 +252,37 @@ enum st_token {
  * * `const char *operators` - Characters that should be treated as operators.
  *   If `st_next_token()` encounters any of these characters in the input stream,
  *   it will return the character verbatim.
+ *   Use `st_operators()` for operators longer than a single character.
  *
  * These members are used when a token has been read with `st_next_token()`:
  *
  * * `int token` - The last token that was read by `st_next_token()`.
  *   It will be one of the `st_token` values, or an ASCII character if
  *   the input matched one of the characters in `operators`
- * * `char value[]` - The string containing the value of the token (the _"lexeme"_)
+ * * `const char *text` and `size_t len` - The value of the token (the _"lexeme"_)
  *   when a `ST_WORD`, `ST_STRING` or `ST_NUMBER` token has been read from the input
- *   stream. In the case of `ST_NUMBER`, the C standard `atoi()`, `atof()`, or
- *   `strtol()` functions can be used to convert it to the appropriate numeric
- *   type.
+ *   stream. For strings it excludes the quotes.  \
+ *   Where possible, `text` points directly into the block of input being
+ *   scanned, so it is **not** null-terminated and it is only valid until the
+ *   next call to `st_next_token()`. Only strings containing escape sequences
+ *   and words in `lowercaseMode` are copied to an internal buffer.  \
+ *   Use `st_value()` if you need a null-terminated string, for example to
+ *   pass an `ST_NUMBER` to the C standard `atoi()`, `atof()`, or `strtol()`
+ *   functions.
+ * * `long offset` and `long end_offset` - The byte offsets in the input of
+ *   the first character of the token and of the character just after it,
+ *   so that the token can be found again with `fseek()`. For strings,
+ *   these include the quotes.
+ * * `int line` and `int column` - The line on which the token starts, and
+ *   the column (in bytes, starting at 1) of its first character.
+ *   (`lineno` is the line on which it ends)
  *
  * These members are used when an error occurred in `st_next_token()` (in which
  * case `st_next_token()` will return `ST_ERROR`):
  *
  * * `int lineno` - The number of the line on which the error occurred.
+ * * `long end_offset` - The byte offset in the input where the error was
+ *   detected.
  * * `const char *error_desc` -  a description of the error.
  */
 typedef struct StrmTok {
@@ -241,12 +294,20 @@ typedef struct StrmTok {
     /* The internal buffer, where bytes are read into
     from the file, but before they're processed. */
     char raw_buffer[ST_READ_BUFFER_SIZE];
-    int in_pos;
 
-    int last_read;
+    /* The block currently being scanned: `buf` is `raw_buffer` unless
+    a token outgrew it. `pos` is the next unread byte, `end` is the end
+    of the valid bytes and everything from `mark` onwards is kept when
+    the block is refilled. */
+    char *buf;
+    size_t cap;
+    const char *pos, *end, *mark;
+    int eof;
 
-    int unget_buf[ST_UNGET_COUNT];
-    int unget_pos;
+    /* `read_offset` is the offset in the input of `end`, from which the
+    offset of any position in the block follows, and `line_offset` is the
+    offset of the start of the current line. */
+    long read_offset, line_offset;
 
     int lineno;
     const char *error_desc;
@@ -263,10 +324,53 @@ typedef struct StrmTok {
     const char *word_chars;
     const char *operators;
 
+    /* Operators registered through st_operators() */
+    const char *const *long_operators;
+
+    /* Character class table and trie of operators and delimiters compiled
+    from the configuration above, and the configuration it was compiled from.
+    `trie` is `trie_buffer` until it needs to grow */
+    unsigned char cclass[256];
+    struct st_trie_node *trie;
+    int trie_n, trie_a;
+    struct st_trie_node trie_buffer[ST_TRIE_SIZE];
+    const char *cc_comment_chars, *cc_quote_chars;
+    const char *cc_word_chars, *cc_operators;
+    const char *cc_single_comment, *cc_multi_comment_start, *cc_multi_string_start;
+    const char *const *cc_long_operators;
+    int cc_significantEol;
+
     int token;
 
-    int p;
-    char value[ST_BUFFER_SIZE];
+    /* The value of the token; either a view into the block, or `copy` */
+    const char *text;
+    size_t len;
+
+    /* Position of the token in the input */
+    long offset, end_offset;
+    int line, column;
+
+    /* The buffer where tokens that need to be transformed are copied.
+    `copy` is `copy_buffer` until it needs to grow */
+    char *copy;
+    size_t copy_len, copy_cap;
+    char copy_buffer[ST_BUFFER_SIZE];
+
+    /* Keywords registered through st_keywords(), and the perfect hash
+    table they were compiled into. `kw_table` holds `kw_mask + 1` entries
+    of keyword index + 1 (0 for empty slots), followed by the length of
+    each keyword. It is `kw_buffer` if the table fits */
+    const char *const *keywords;
+    int *kw_table;
+    unsigned int kw_mask, kw_seed;
+    int kw_buffer[ST_KEYWORD_TABLE_SIZE];
+
+#if ST_STATS
+    /* Profiling counters */
+    struct st_stats {
+        unsigned long tokens, refills, grows, ungets, bytes;
+    } stats;
+#endif
 
 } StrmTok;
 
@@ -347,6 +451,44 @@ struct st_string_strm {
 
 _ST_EXPORT void st_init_string(StrmTok *st, struct st_string_strm *strm);
 
+/**
+ * ### `int st_configure(StrmTok *st)`
+ *
+ * Compiles the configuration members of `st` into the internal lookup
+ * table that `st_next_token()` uses to classify characters, and the trie
+ * that it uses to match operators and comment and string delimiters in a
+ * single forward pass.
+ *
+ * `st_next_token()` calls it automatically when it notices that one of
+ * those members has been changed, so you only need to call it yourself
+ * if you modify the contents of a configuration string in place.
+ *
+ * It returns 1 on success, and 0 if memory could not be allocated.
+ */
+_ST_EXPORT int st_configure(StrmTok *st);
+
+/**
+ * ### `int st_operators(StrmTok *st, const char *const *operators)`
+ *
+ * Registers a `NULL`-terminated list of `operators` that may be longer
+ * than one character, like `"<="`, `"=="`, `"->"` or `"::"`.
+ *
+ * When `st_next_token()` encounters `operators[i]` in the input, it returns
+ * `ST_OPERATOR + i`. The longest matching operator always wins, so `"<"`
+ * in `StrmTok.operators` and `"<="` and `"<<="` registered here can be
+ * used together.
+ *
+ * Operators and the comment and string delimiters are matched before
+ * words and numbers, so an operator may start with a letter or digit.
+ * An operator that ends with a word character is only matched if it is
+ * not followed by another word character, so with `"and"` registered,
+ * `android` is still read as a single `ST_WORD`.
+ *
+ * The list is not copied, so it must remain valid while `st` is in use.
+ * It returns 1 on success, and 0 if memory could not be allocated.
+ */
+_ST_EXPORT int st_operators(StrmTok *st, const char *const *operators);
+
 /**
  * ### `int st_next_token(StrmTok *st)`
  *
@@ -357,6 +499,54 @@ _ST_EXPORT void st_init_string(StrmTok *st, struct st_string_strm *strm);
  */
 _ST_EXPORT int st_next_token(StrmTok *st);
 
+/**
+ * ### `const char *st_value(StrmTok *st)`
+ *
+ * Returns the value of the last token read by `st_next_token()` as a
+ * null-terminated string.
+ *
+ * If `StrmTok.text` points into the input block, it is first copied
+ * to the internal buffer. The returned string is only valid until the
+ * next call to `st_next_token()`.
+ *
+ * It returns `NULL` if memory could not be allocated.
+ */
+_ST_EXPORT const char *st_value(StrmTok *st);
+
+/**
+ * ### `int st_keywords(StrmTok *st, const char *const *keywords)`
+ *
+ * Registers a `NULL`-terminated list of `keywords` with `st`.
+ *
+ * When `st_next_token()` then reads a word that matches `keywords[i]`, it
+ * returns `ST_KEYWORD + i` instead of `ST_WORD`, so parsers can dispatch on
+ * keywords without comparing strings. In `lowercaseMode` the keywords should
+ * be given in lowercase.
+ *
+ * The keywords are compiled into a perfect hash table, so recognising a
+ * keyword costs one hash of the word and a single comparison to confirm the
+ * match. The list is not copied, so it must remain valid while `st` is in use.
+ *
+ * Call it after `st_init_custom()`, `st_init_file()` or `st_init_string()`.
+ * It returns 1 on success, and 0 if memory could not be allocated or the list
+ * contains duplicates.
+ */
+_ST_EXPORT int st_keywords(StrmTok *st, const char *const *keywords);
+
+/**
+ * ### `void st_free(StrmTok *st)`
+ *
+ * Releases any memory that `st` allocated while tokenizing.
+ *
+ * Memory is only allocated when a token is longer than
+ * `ST_READ_BUFFER_SIZE` or `ST_BUFFER_SIZE`, or when the operators or
+ * keywords do not fit in `ST_TRIE_SIZE` or `ST_KEYWORD_TABLE_SIZE`. It is
+ * released automatically when `st_next_token()` reaches the end of the
+ * input or fails, so you only need to call this if you stop tokenizing
+ * before `ST_EOF` is returned, or before initialising `st` again.
+ */
+_ST_EXPORT void st_free(StrmTok *st);
+
 /* ==============================================================================
 Implementation
 ============================================================================== */
@@ -364,6 +554,7 @@ Implementation
 #  if defined(STRMTOK_IMPLEMENTATION) || defined(STRMTOK_TEST)
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
@@ -374,46 +565,297 @@ Implementation
 #  define CAST(x, y)   y
 #endif
 
+/* Offset in the input of the position `p` in the block */
+#define _ST_OFFSET(st, p)   ((st)->read_offset - (long)((st)->end - (p)))
+
+/* Counts the newline at position `p` in the block */
+#define _ST_NEWLINE(st, p)  ((st)->lineno++, (st)->line_offset = _ST_OFFSET(st, (p) + 1))
+
+#if ST_STATS
+#  define _ST_STAT(st, field, n) ((st)->stats.field += (n))
+#else
+#  define _ST_STAT(st, field, n) ((void)0)
+#endif
+
+/* Refills the block, keeping everything from `st->mark` onwards.
+ * It returns the number of new bytes available at `st->pos`, and 0 at
+ * the end of the input (or if memory could not be allocated). */
+static int _st_refill(StrmTok *st) {
+    size_t keep;
+    int cnt;
+
+    if(st->eof || !st->get_data)
+        return 0;
+
+    _ST_STAT(st, refills, 1);
+    keep = st->end - st->mark;
+    if(keep == st->cap) {
+        /* A token outgrew the block, so enlarge it */
+        size_t ncap = st->cap << 1;
+        char *nb;
+        if(st->buf == st->raw_buffer) {
+            nb = CAST(char *, malloc(ncap));
+            if(nb)
+                memcpy(nb, st->mark, keep);
+        } else
+            nb = CAST(char *, realloc(st->buf, ncap));
+        if(!nb) {
+            st->error_desc = "out of memory";
+            st->eof = -1;
+            return 0;
+        }
+        st->buf = nb;
+        st->cap = ncap;
+        _ST_STAT(st, grows, 1);
+    } else if(st->mark != st->buf) {
+        memmove(st->buf, st->mark, keep);
+    }
+    st->pos = st->buf + (st->pos - st->mark);
+    st->mark = st->buf;
+    st->end = st->buf + keep;
+
+    cnt = st->get_data(st->buf + keep, (int)(st->cap - keep), st->data);
+    if(cnt <= 0) {
+        st->eof = 1;
+        return 0;
+    }
+    st->end += cnt;
+    st->read_offset += cnt;
+    _ST_STAT(st, bytes, cnt);
+    return cnt;
+}
+
 static int _st_get_char(StrmTok *st) {
-    char c = 0;
-    if(st->last_read == EOF) {
+    if(st->pos == st->end && !_st_refill(st))
         return EOF;
-    } else if(st->unget_pos > 0) {
-        c = st->unget_buf[--st->unget_pos];
-        st->last_read = c;
-        return c;
-    }
-    if(st->in_pos >= ST_READ_BUFFER_SIZE || (c = st->raw_buffer[st->in_pos++]) == '\0') {
-        int cnt = st->get_data(st->raw_buffer, ST_READ_BUFFER_SIZE - 1, st->data);
-        if(!cnt) {
-            st->last_read = EOF;
-            return EOF;
+    return (unsigned char)*st->pos++;
+}
+
+/* Only characters read since `st->mark` was last set can be ungotten */
+static void _st_unget_char(StrmTok *st, int c) {
+    if(c == EOF)
+        return;
+    assert(st->pos > st->mark);
+    st->pos--;
+    _ST_STAT(st, ungets, 1);
+}
+
+/* Character classes in `StrmTok.cclass` */
+#define _ST_C_SPACE     0x01
+#define _ST_C_COMMENT   0x02
+#define _ST_C_WORD1     0x04
+#define _ST_C_WORD      0x08
+#define _ST_C_DIGIT     0x10
+#define _ST_C_QUOTE     0x20
+#define _ST_C_TRIE      0x40
+
+#define _ST_CLASS(st, c)    ((c) == EOF ? 0 : (st)->cclass[(unsigned char)(c)])
+
+/* Accept codes in the trie for the comment and string delimiters.
+Single character operators accept with the character itself, and
+operators from st_operators() with ST_OPERATOR + i */
+#define _ST_T_LINE_COMMENT      -1
+#define _ST_T_BLOCK_COMMENT     -2
+#define _ST_T_MULTI_STRING      -3
+
+static void _st_set_class(StrmTok *st, const char *chars, int cls) {
+    if(!chars) return;
+    for(; chars[0]; chars++)
+        st->cclass[(unsigned char)chars[0]] |= cls;
+}
+
+static int _st_trie_node(StrmTok *st, int c) {
+    struct st_trie_node *node;
+    if(st->trie_n == st->trie_a) {
+        int na = st->trie_a << 1;
+        struct st_trie_node *nt;
+        if(st->trie == st->trie_buffer) {
+            nt = CAST(struct st_trie_node *, malloc(na * sizeof *nt));
+            if(nt)
+                memcpy(nt, st->trie, st->trie_n * sizeof *nt);
+        } else
+            nt = CAST(struct st_trie_node *, realloc(st->trie, na * sizeof *nt));
+        if(!nt)
+            return -1;
+        st->trie = nt;
+        st->trie_a = na;
+    }
+    node = &st->trie[st->trie_n];
+    node->c = c;
+    node->child = node->sibling = -1;
+    node->accept = 0;
+    return st->trie_n++;
+}
+
+/* Adds `s` to the trie. If `s` is already in the trie,
+the first accept code it was added with is kept */
+static int _st_trie_insert(StrmTok *st, const char *s, int accept) {
+    int n = 0;
+    if(!s || !s[0])
+        return 1;
+    st->cclass[(unsigned char)s[0]] |= _ST_C_TRIE;
+    for(; s[0]; s++) {
+        int c = (unsigned char)s[0], k;
+        for(k = st->trie[n].child; k >= 0 && st->trie[k].c != c; k = st->trie[k].sibling);
+        if(k < 0) {
+            if((k = _st_trie_node(st, c)) < 0)
+                return 0;
+            st->trie[k].sibling = st->trie[n].child;
+            st->trie[n].child = k;
         }
-        st->in_pos = 0;
-        c = st->raw_buffer[st->in_pos++];
+        n = k;
     }
-    return c;
+    if(!st->trie[n].accept)
+        st->trie[n].accept = accept;
+    return 1;
 }
 
-static void _st_unget_char(StrmTok *st, int c) {
-    assert(st->unget_pos < ST_UNGET_COUNT);
-    st->unget_buf[st->unget_pos++] = c;
+_ST_EXPORT int st_configure(StrmTok *st) {
+    int i;
+    const char *o;
+    for(i = 0; i < 256; i++) {
+        int cls = 0;
+        if(isalpha(i))
+            cls |= _ST_C_WORD1 | _ST_C_WORD;
+        else if(isdigit(i))
+            cls |= _ST_C_WORD | _ST_C_DIGIT;
+        st->cclass[i] = cls;
+    }
+    _st_set_class(st, st->significantEol ? " \t\r" : " \t\r\n", _ST_C_SPACE);
+    _st_set_class(st, st->comment_chars, _ST_C_COMMENT);
+    _st_set_class(st, st->word_chars, _ST_C_WORD1 | _ST_C_WORD);
+    _st_set_class(st, st->quote_chars, _ST_C_QUOTE);
+
+    st->cc_comment_chars = st->comment_chars;
+    st->cc_quote_chars = st->quote_chars;
+    st->cc_word_chars = st->word_chars;
+    st->cc_operators = st->operators;
+    st->cc_single_comment = st->single_comment;
+    st->cc_multi_comment_start = st->multi_comment_start;
+    st->cc_multi_string_start = st->multi_string_start;
+    st->cc_long_operators = st->long_operators;
+    st->cc_significantEol = st->significantEol;
+
+    /* The delimiters are added first so that they take precedence */
+    st->trie_n = 0;
+    if(_st_trie_node(st, 0) < 0
+        || !_st_trie_insert(st, st->single_comment, _ST_T_LINE_COMMENT)
+        || !_st_trie_insert(st, st->multi_comment_start, _ST_T_BLOCK_COMMENT)
+        || !_st_trie_insert(st, st->multi_string_start, _ST_T_MULTI_STRING))
+        goto error;
+    if(st->operators) {
+        for(o = st->operators; o[0]; o++) {
+            char op[2];
+            op[0] = o[0];
+            op[1] = '\0';
+            if(!_st_trie_insert(st, op, (unsigned char)o[0]))
+                goto error;
+        }
+    }
+    if(st->long_operators) {
+        for(i = 0; st->long_operators[i]; i++)
+            if(!_st_trie_insert(st, st->long_operators[i], ST_OPERATOR + i))
+                goto error;
+    }
+    return 1;
+
+error:
+    st->error_desc = "out of memory";
+    st->token = ST_ERROR;
+    return 0;
+}
+
+_ST_EXPORT int st_operators(StrmTok *st, const char *const *operators) {
+    st->long_operators = operators;
+    return st_configure(st);
+}
+
+/* Makes sure at least `n` bytes are available from `st->pos` */
+static int _st_lookahead(StrmTok *st, size_t n) {
+    while((size_t)(st->end - st->pos) < n) {
+        if(!_st_refill(st))
+            return 0;
+    }
+    return 1;
+}
+
+/* Finds the longest operator or delimiter in the trie starting at `st->pos`,
+ * in a single forward pass. If one is found, `st->pos` is moved past it and
+ * its accept code is returned, otherwise `st->pos` is left unchanged.
+ * A match that ends in a word character only counts if the next character
+ * is not a word character, so that an operator like `"and"` does not
+ * match the start of `android`. */
+static int _st_match_trie(StrmTok *st) {
+    size_t start = st->pos - st->mark, k = start, best_len = 0;
+    int n = 0, best = 0, pending = 0;
+    for(;;) {
+        int c = EOF;
+        if(st->mark + k < st->end || _st_refill(st))
+            c = (unsigned char)st->mark[k];
+        if(pending) {
+            /* the previous match ended in a word character */
+            if(!(_ST_CLASS(st, c) & _ST_C_WORD)) {
+                best = pending;
+                best_len = k;
+            }
+            pending = 0;
+        }
+        if(c == EOF)
+            break;
+        for(n = st->trie[n].child; n >= 0 && st->trie[n].c != c; n = st->trie[n].sibling);
+        if(n < 0)
+            break;
+        k++;
+        if(st->trie[n].accept) {
+            if(_ST_CLASS(st, c) & _ST_C_WORD)
+                pending = st->trie[n].accept;
+            else {
+                best = st->trie[n].accept;
+                best_len = k;
+            }
+        }
+    }
+    if(best)
+        st->pos = st->mark + best_len;
+    return best;
 }
 
 _ST_EXPORT void st_init_custom(StrmTok *st, st_read_data_fun fun, void *data) {
     st->get_data = fun;
     st->data = data;
 
-    st->unget_pos = 0;
+    st->buf = st->raw_buffer;
+    st->cap = ST_READ_BUFFER_SIZE;
+    st->pos = st->end = st->mark = st->buf;
+    st->eof = 0;
 
-    st->in_pos = ST_READ_BUFFER_SIZE;
     st->token = ST_EOL;
 
+    st->read_offset = st->line_offset = 0;
+    st->offset = st->end_offset = 0;
+    st->line = st->column = 1;
+
     st->lineno = 1;
     st->error_desc = "no error";
 
-    st->value[0] = '\0';
-    st->p = 0;
+    st->copy = st->copy_buffer;
+    st->copy_cap = ST_BUFFER_SIZE;
+    st->copy_len = 0;
+    st->copy[0] = '\0';
+    st->text = st->copy;
+    st->len = 0;
+
+    st->keywords = NULL;
+    st->kw_table = NULL;
+
+    st->long_operators = NULL;
+    st->trie = st->trie_buffer;
+    st->trie_n = 0;
+    st->trie_a = ST_TRIE_SIZE;
+
+#if ST_STATS
+    memset(&st->stats, 0, sizeof st->stats);
+#endif
 
     st->lowercaseMode = ST_DEFAULT_LOWERCASE_MODE;
     st->significantEol = ST_DEFAULT_SIGNIFICANT_EOL;
@@ -426,265 +868,583 @@ _ST_EXPORT void st_init_custom(StrmTok *st, st_read_data_fun fun, void *data) {
     st->multi_string_end = ST_DEFAULT_MULTI_STRING_END;
     st->word_chars = ST_DEFAULT_WORD_CHARS;
     st->operators = ST_DEFAULT_OPERATORS;
+
+    st_configure(st);
 }
 
-static int _st_file_input_get_line(char *str, int num, void *data) {
-    size_t read;
+_ST_EXPORT void st_free(StrmTok *st) {
+    if(st->buf != st->raw_buffer) {
+        free(st->buf);
+        st->buf = st->raw_buffer;
+        st->cap = ST_READ_BUFFER_SIZE;
+        st->pos = st->end = st->mark = st->buf;
+    }
+    if(st->copy != st->copy_buffer) {
+        free(st->copy);
+        st->copy = st->copy_buffer;
+        st->copy_cap = ST_BUFFER_SIZE;
+        st->copy_len = 0;
+        st->copy[0] = '\0';
+        st->text = st->copy;
+        st->len = 0;
+    }
+    if(st->kw_table) {
+        if(st->kw_table != st->kw_buffer)
+            free(st->kw_table);
+        st->kw_table = NULL;
+        st->keywords = NULL;
+    }
+    if(st->trie != st->trie_buffer) {
+        free(st->trie);
+        st->trie = st->trie_buffer;
+        st->trie_n = 0;
+        st->trie_a = ST_TRIE_SIZE;
+    }
+}
+
+static int _st_file_input_get_data(char *str, int num, void *data) {
     FILE *file = CAST(FILE*, data);
     if(feof(file))
         return 0;
-    read = fread(str, 1, num, file);
-    str[read] = '\0';
-    if(!read)
-        return 0;
-    return 1;
+    return (int)fread(str, 1, num, file);
 }
 
 _ST_EXPORT void st_init_file(StrmTok *st, FILE *file) {
     assert(file != NULL);
-    st_init_custom(st, _st_file_input_get_line, file);
+    st_init_custom(st, _st_file_input_get_data, file);
 }
 
-static int _st_file_input_get_line_limit(char *str, int num, void *data) {
+static int _st_file_input_get_data_limit(char *str, int num, void *data) {
     size_t read;
     struct st_read_limit *ll = CAST(struct st_read_limit *, data);
     if(!ll->limit) return 0;
-    num--;
     if(num > ll->limit)
         num = ll->limit;
     read = fread(str, 1, num, ll->f);
-    str[read] = '\0';
-    if(!read)
-        return 0;
-    ll->limit -= strlen(str);
-    return 1;
+    ll->limit -= (int)read;
+    return (int)read;
 }
 
 void st_init_file_limit(StrmTok *st, struct st_read_limit *ll) {
     assert(ll->f != NULL);
     assert(ll->limit > 0);
-    st_init_custom(st, _st_file_input_get_line_limit, ll);
+    st_init_custom(st, _st_file_input_get_data_limit, ll);
 }
 
-static int _st_string_input_get_line(char *str, int num, void *data) {
-    struct st_string_strm *strm = CAST(struct st_string_strm *, data);
+/* Strings are scanned in place as a single block, so there is
+no `st_read_data_fun` to call */
+_ST_EXPORT void st_init_string(StrmTok *st, struct st_string_strm *strm) {
+    st_init_custom(st, NULL, strm);
+    st->pos = st->mark = strm->str;
+    st->end = strm->str + strm->len;
+    st->read_offset = strm->len;
+    strm->p = strm->len;
+    _ST_STAT(st, bytes, strm->len);
+}
 
-    if(strm->p >= strm->len)
-        return 0;
-    else if(strm->p + num > strm->len) {
-        num = strm->len - strm->p;
+/* Appends `n` bytes to the copy buffer, growing it if needed.
+The copy buffer is always kept null-terminated */
+static int _st_copy(StrmTok *st, const char *s, size_t n) {
+    if(st->copy_len + n + 1 > st->copy_cap) {
+        size_t ncap = st->copy_cap << 1;
+        char *nc;
+        while(ncap < st->copy_len + n + 1)
+            ncap <<= 1;
+        if(st->copy == st->copy_buffer) {
+            nc = CAST(char *, malloc(ncap));
+            if(nc)
+                memcpy(nc, st->copy, st->copy_len);
+        } else
+            nc = CAST(char *, realloc(st->copy, ncap));
+        if(!nc) {
+            st->error_desc = "out of memory";
+            return 0;
+        }
+        st->copy = nc;
+        st->copy_cap = ncap;
     }
-
-    memcpy(str, strm->str + strm->p, num);
-    str[num] = '\0';
-
-    strm->p += num;
-
+    memcpy(st->copy + st->copy_len, s, n);
+    st->copy_len += n;
+    st->copy[st->copy_len] = '\0';
     return 1;
 }
 
-_ST_EXPORT void st_init_string(StrmTok *st, struct st_string_strm *strm) {
-    st_init_custom(st, _st_string_input_get_line, strm);
-    strm->p = 0;
+static int _st_copy_char(StrmTok *st, int c) {
+    char ch = (char)c;
+    return _st_copy(st, &ch, 1);
 }
 
-static int match_long_token(StrmTok *st, int c, const char *token) {
-    if(!token[0]) {
-        _st_unget_char(st, c);
-        return 1;
+_ST_EXPORT const char *st_value(StrmTok *st) {
+    if(st->text != st->copy) {
+        st->copy_len = 0;
+        if(!_st_copy(st, st->text, st->len))
+            return NULL;
+        st->text = st->copy;
     }
-    if(c == token[0]) {
+    return st->copy;
+}
+
+/* Checks whether the delimiter `d` appears at `st->pos`, and if so
+moves `st->pos` past it */
+static int _st_match_delim(StrmTok *st, const char *d, size_t len) {
+    if(!_st_lookahead(st, len) || memcmp(st->pos, d, len))
+        return 0;
+    st->pos += len;
+    return 1;
+}
+
+/* Reads the 4 hex digits of a \uXXXX escape sequence */
+static long _st_read_hex4(StrmTok *st) {
+    long u = 0;
+    int i, c;
+    for(i = 0; i < 4; i++) {
         c = _st_get_char(st);
-        if(match_long_token(st, c, token + 1)) {
-            return 1;
-        } else {
-            _st_unget_char(st, c);
+        if(c >= '0' && c <= '9')
+            u = (u << 4) + c - '0';
+        else if(c >= 'a' && c <= 'f')
+            u = (u << 4) + c - 'a' + 0x0A;
+        else if(c >= 'A' && c <= 'F')
+            u = (u << 4) + c - 'A' + 0x0A;
+        else {
+            st->error_desc = "bad '\\uXXXX' sequence";
+            return -1;
         }
     }
-    return 0;
+    return u;
 }
 
-static int _st_read_string_char(StrmTok *st, int c) {
-    if(!c || c == EOF) {
+/* Appends the UTF-8 encoding of the codepoint `cp` to the copy buffer */
+static int _st_copy_utf8(StrmTok *st, long cp) {
+    char b[4];
+    size_t n;
+    if(cp <= 0x7F) {
+        b[0] = (char)cp;
+        n = 1;
+    } else if(cp <= 0x07FF) {
+        b[0] = (char)(0xC0 | (cp >> 6));
+        b[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if(cp <= 0xFFFF) {
+        b[0] = (char)(0xE0 | (cp >> 12));
+        b[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        b[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        b[0] = (char)(0xF0 | (cp >> 18));
+        b[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        b[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        b[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    return _st_copy(st, b, n);
+}
+
+/* Reads the escape sequence following a '\\' in a string,
+and appends the character it represents to the copy buffer.
+`\uXXXX` escapes are encoded as UTF-8, and UTF-16 surrogate pairs
+(`\uD83D\uDE00`) are combined into a single codepoint. */
+static int _st_read_escape(StrmTok *st) {
+    int c = _st_get_char(st);
+    long u, ls;
+    if(!c || c == '\n' || c == EOF) {
         st->error_desc = "unterminated string constant";
         return 0;
     }
-    if(st->p >= ST_BUFFER_SIZE) {
-        st->error_desc = "token too long for value buffer";
-        return 0;
+    switch(c) {
+        case 'a' : c = '\a'; break;
+        case 'b' : c = '\b'; break;
+        case 'e' : c = 0x1B; break;
+        case 'f' : c = '\f'; break;
+        case 'n' : c = '\n'; break;
+        case 'r' : c = '\r'; break;
+        case 't' : c = '\t'; break;
+        case 'v' : c = '\v'; break;
+        case 'u' :
+            if((u = _st_read_hex4(st)) < 0)
+                return 0;
+            if(u >= 0xDC00 && u <= 0xDFFF) {
+                st->error_desc = "unexpected low surrogate in '\\uXXXX' sequence";
+                return 0;
+            }
+            if(u >= 0xD800 && u <= 0xDBFF) {
+                if(_st_get_char(st) != '\\' || _st_get_char(st) != 'u') {
+                    st->error_desc = "expected a surrogate pair in '\\uXXXX' sequence";
+                    return 0;
+                }
+                if((ls = _st_read_hex4(st)) < 0)
+                    return 0;
+                if(ls < 0xDC00 || ls > 0xDFFF) {
+                    st->error_desc = "expected a surrogate pair in '\\uXXXX' sequence";
+                    return 0;
+                }
+                u = ((u - 0xD800) << 10) + (ls - 0xDC00) + 0x10000;
+            }
+            return _st_copy_utf8(st, u);
+        default : break;
     }
-    if(c == '\\') {
-        c = _st_get_char(st);
-        if(!c || c == '\n' || c == EOF) {
+    return _st_copy_char(st, c);
+}
+
+/* Reads the body of a string that started `body` bytes after `st->mark`.
+ * `term` is the terminating quote character, or `EOF` for multi-line
+ * strings, which are terminated by `st->multi_string_end`.
+ *
+ * Runs of plain characters are scanned in bulk up to the next quote,
+ * backslash, newline or NUL. The body is left in the block as long as no
+ * escape sequences are encountered; after that the runs are copied
+ * to the copy buffer a span at a time. */
+static int _st_read_string(StrmTok *st, int term, size_t body) {
+    int c, copying = 0;
+    size_t stop, dlen = 0;
+    char q = (char)term;
+    const char *p, *end;
+
+    if(term == EOF) {
+        dlen = strlen(st->multi_string_end);
+        q = st->multi_string_end[0];
+    }
+
+    for(;;) {
+        p = st->pos;
+        end = st->end;
+        while(p < end && *p != q && *p != '\\' && *p != '\n' && *p)
+            p++;
+        if(copying) {
+            if(p > st->pos && !_st_copy(st, st->pos, p - st->pos))
+                return 0;
+            st->mark = p;
+        }
+        st->pos = p;
+        if(p == end) {
+            if(!_st_refill(st)) {
+                if(st->eof >= 0)
+                    st->error_desc = "unterminated string constant";
+                return 0;
+            }
+            continue;
+        }
+
+        stop = st->pos - st->mark;
+        if(term != EOF && *p == q) {
+            st->pos++;
+            break;
+        }
+        if(term == EOF && *p == q && _st_match_delim(st, st->multi_string_end, dlen))
+            break;
+
+        c = (unsigned char)*st->pos++;
+        if(c == '\n' && term == EOF) {
+            _ST_NEWLINE(st, st->pos - 1);
+        } else if(!c || c == '\n') {
             st->error_desc = "unterminated string constant";
             return 0;
         }
-        switch(c) {
-            case 'a' : st->value[st->p++] = '\a'; break;
-            case 'b' : st->value[st->p++] = '\b'; break;
-            case 'e' : st->value[st->p++] = 0x1B; break;
-            case 'f' : st->value[st->p++] = '\f'; break;
-            case 'n' : st->value[st->p++] = '\n'; break;
-            case 'r' : st->value[st->p++] = '\r'; break;
-            case 't' : st->value[st->p++] = '\t'; break;
-            case 'v' : st->value[st->p++] = '\v'; break;
-            default :  st->value[st->p++] = c; break;
+        if(c == '\\') {
+            if(!copying) {
+                st->copy_len = 0;
+                if(!_st_copy(st, st->mark + body, stop - body))
+                    return 0;
+                copying = 1;
+            }
+            if(!_st_read_escape(st))
+                return 0;
+        } else if(copying && !_st_copy_char(st, c)) {
+            return 0;
         }
-        /* TODO: JSON/JavaScript-style \uXXXX UTF-8 escapes (with surrogate pairs) */
+        if(copying)
+            st->mark = st->pos;
+    }
+    if(copying) {
+        st->text = st->copy;
+        st->len = st->copy_len;
     } else {
-        st->value[st->p++] = c;
+        st->text = st->mark + body;
+        st->len = stop - body;
     }
     return 1;
 }
 
-#define ST_APPEND(c) do{st->value[st->p++] = (c); \
-            if(st->p >= ST_BUFFER_SIZE) { \
-                st->error_desc = "token too long for value buffer"; \
-                goto error; \
-            }} while(0)
+/* Hash function for the keyword table: FNV-1a, with `seed` perturbing
+the offset basis, followed by a final avalanche step */
+static unsigned int _st_hash(const char *s, size_t len, unsigned int seed) {
+    unsigned int h = 0x811c9dc5 ^ (seed * 0x9E3779B1);
+    size_t i;
+    for(i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 0x01000193;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    return h;
+}
+
+/* Builds a collision free table by trying different seeds, enlarging
+the table whenever a size runs out of seeds */
+_ST_EXPORT int st_keywords(StrmTok *st, const char *const *keywords) {
+    unsigned int n, m, seed, i;
+    int *table, *lens;
+
+    for(n = 0; keywords[n]; n++);
+    for(m = 8; m < 2 * n; m <<= 1);
+
+    if(st->kw_table && st->kw_table != st->kw_buffer)
+        free(st->kw_table);
+    st->kw_table = NULL;
+    st->keywords = NULL;
+
+    for(; m <= (1u << 20); m <<= 1) {
+        if(m + n <= ST_KEYWORD_TABLE_SIZE)
+            table = st->kw_buffer;
+        else
+            table = CAST(int *, malloc((m + n) * sizeof *table));
+        if(!table) {
+            st->error_desc = "out of memory";
+            return 0;
+        }
+        lens = table + m;
+        for(i = 0; i < n; i++)
+            lens[i] = (int)strlen(keywords[i]);
+        for(seed = 1; seed <= 64; seed++) {
+            memset(table, 0, m * sizeof *table);
+            for(i = 0; i < n; i++) {
+                unsigned int h = _st_hash(keywords[i], lens[i], seed) & (m - 1);
+                if(table[h]) {
+                    if(!strcmp(keywords[table[h] - 1], keywords[i])) {
+                        if(table != st->kw_buffer)
+                            free(table);
+                        st->error_desc = "duplicate keyword";
+                        return 0;
+                    }
+                    break;
+                }
+                table[h] = i + 1;
+            }
+            if(i == n) {
+                st->keywords = keywords;
+                st->kw_table = table;
+                st->kw_mask = m - 1;
+                st->kw_seed = seed;
+                return 1;
+            }
+        }
+        if(table != st->kw_buffer)
+            free(table);
+    }
+    st->error_desc = "unable to build keyword table";
+    return 0;
+}
+
+static int _st_find_keyword(StrmTok *st, const char *s, size_t len) {
+    unsigned int h = _st_hash(s, len, st->kw_seed) & st->kw_mask;
+    int k = st->kw_table[h] - 1;
+    if(k >= 0 && (size_t)st->kw_table[st->kw_mask + 1 + k] == len
+        && !memcmp(st->keywords[k], s, len))
+        return k;
+    return -1;
+}
+
+/* Advances `st->pos` past the run of characters of class `cls`. The run
+ * is scanned directly inside the block; the block is only refilled
+ * (keeping the token from `st->mark`) when the run reaches its end. */
+static void _st_scan_run(StrmTok *st, int cls) {
+    for(;;) {
+        const char *p = st->pos, *end = st->end;
+        while(p < end && (st->cclass[(unsigned char)*p] & cls))
+            p++;
+        st->pos = p;
+        if(p < end || !_st_refill(st))
+            return;
+    }
+}
 
 _ST_EXPORT int st_next_token(StrmTok *st) {
-    int c;
-    const char *whitespace = st->significantEol ? " \t\r" : " \t\r\n";
+    int c, action = 0;
 
     assert(st != NULL);
 
     if(st->token == ST_EOF || st->token == ST_ERROR)
         return st->token;
 
-restart:
-    do {
-        c = _st_get_char(st);
-        if(c == EOF)
-            goto eof;
-        if(c == '\n')
-            st->lineno++;
-    } while(strchr(whitespace, c));
-
-    if((st->comment_chars && strchr(st->comment_chars, c))
-        || (st->single_comment && match_long_token(st, c, st->single_comment))
-    ) {
-        do {
-            c = _st_get_char(st);
-            if(c == EOF)
-                goto eof;
-        } while(c != '\n');
-        st->lineno++;
-        goto restart;
-    } else if(st->multi_comment_start && match_long_token(st, c, st->multi_comment_start)) {
-        do {
-            c = _st_get_char(st);
-        } while(!match_long_token(st, c, st->multi_comment_end));
-        goto restart;
+    if(st->cc_comment_chars != st->comment_chars
+        || st->cc_quote_chars != st->quote_chars
+        || st->cc_word_chars != st->word_chars
+        || st->cc_operators != st->operators
+        || st->cc_single_comment != st->single_comment
+        || st->cc_multi_comment_start != st->multi_comment_start
+        || st->cc_multi_string_start != st->multi_string_start
+        || st->cc_long_operators != st->long_operators
+        || st->cc_significantEol != st->significantEol) {
+        if(!st_configure(st))
+            goto error;
     }
 
-    if(st->significantEol && c == '\n') {
-        st->token = ST_EOL;
-    } else if(isalpha(c) || (st->word_chars && strchr(st->word_chars, c))) {
-
-        st->value[0] = '\0';
-        st->p = 0;
-
-        do {
-            ST_APPEND(st->lowercaseMode ? tolower(c) : c);
-            c = _st_get_char(st);
-        } while(isalnum(c) || (st->word_chars && strchr(st->word_chars, c)));
-        _st_unget_char(st, c);
-        st->value[st->p] = '\0';
-        st->token = ST_WORD;
-
-    } else if(isdigit(c)) {
-
-        st->value[0] = '\0';
-        st->p = 0;
+    _ST_STAT(st, tokens, 1);
 
-        do {
-            ST_APPEND(c);
-            c = _st_get_char(st);
-        } while(isdigit(c));
+restart:
+    /* Skip whitespace inside the block */
+    for(;;) {
+        while(st->pos < st->end && (st->cclass[(unsigned char)*st->pos] & _ST_C_SPACE)) {
+            if(*st->pos == '\n')
+                _ST_NEWLINE(st, st->pos);
+            st->pos++;
+        }
+        st->mark = st->pos;
+        if(st->pos < st->end || !_st_refill(st))
+            break;
+    }
+    st->offset = _ST_OFFSET(st, st->mark);
+    st->line = st->lineno;
+    st->column = (int)(st->offset - st->line_offset) + 1;
+
+    c = _st_get_char(st);
+    if(c == EOF)
+        goto eof;
+
+    if(_ST_CLASS(st, c) & _ST_C_COMMENT) {
+        action = _ST_T_LINE_COMMENT;
+    } else if(_ST_CLASS(st, c) & _ST_C_TRIE) {
+        st->pos--;
+        action = _st_match_trie(st);
+        if(!action)
+            st->pos++;
+    }
 
-        if(c == '.') {
-            ST_APPEND(c);
-            c = _st_get_char(st);
-            while(isdigit(c)) {
-                ST_APPEND(c);
-                c = _st_get_char(st);
+    if(action == _ST_T_LINE_COMMENT) {
+        for(;;) {
+            const char *nl = CAST(const char *, memchr(st->pos, '\n', st->end - st->pos));
+            if(nl) {
+                st->pos = nl + 1;
+                break;
             }
+            st->pos = st->mark = st->end;
+            if(!_st_refill(st))
+                goto eof;
         }
-        if(tolower(c) == 'e') {
-            ST_APPEND(c);
-            c = _st_get_char(st);
-            if(strchr("+-", c)){
-                ST_APPEND(c);
-                c = _st_get_char(st);
+        _ST_NEWLINE(st, st->pos - 1);
+        action = 0;
+        goto restart;
+    } else if(action == _ST_T_BLOCK_COMMENT) {
+        const char *d = st->multi_comment_end;
+        size_t dlen = strlen(d);
+        for(;;) {
+            const char *p = st->pos, *end = st->end;
+            while(p < end && *p != d[0]) {
+                if(*p == '\n')
+                    _ST_NEWLINE(st, p);
+                p++;
             }
-            while(isdigit(c)){
-                ST_APPEND(c);
-                c = _st_get_char(st);
+            st->pos = st->mark = p;
+            if(p == end) {
+                if(!_st_refill(st)) {
+                    st->error_desc = "unterminated comment";
+                    goto error;
+                }
+            } else if(_st_match_delim(st, d, dlen)) {
+                break;
+            } else {
+                if(*st->pos == '\n')
+                    _ST_NEWLINE(st, st->pos);
+                st->pos++;
             }
         }
+        action = 0;
+        goto restart;
+    }
 
-        _st_unget_char(st, c);
-        st->value[st->p] = '\0';
-        st->token = ST_NUMBER;
-
-    } else if(st->multi_string_start && match_long_token(st, c, st->multi_string_start)) {
+    if(action == _ST_T_MULTI_STRING) {
 
         /* Why is BCC complaining here? */
         if(!st->multi_string_end)
             st->multi_string_end = st->multi_string_start;
 
-        st->value[0] = '\0';
-        st->p = 0;
+        if(!_st_read_string(st, EOF, st->pos - st->mark))
+            goto error;
+        st->token = ST_STRING;
 
-        c = _st_get_char(st);
-        while(!match_long_token(st, c, st->multi_string_end)) {
-            if(!_st_read_string_char(st, c))
+    } else if(action) {
+        st->text = st->mark;
+        st->len = st->pos - st->mark;
+        st->token = action;
+    } else if(st->significantEol && c == '\n') {
+        _ST_NEWLINE(st, st->mark);
+        st->text = st->mark;
+        st->len = 1;
+        st->token = ST_EOL;
+    } else if(_ST_CLASS(st, c) & _ST_C_WORD1) {
+
+        _st_scan_run(st, _ST_C_WORD);
+        st->text = st->mark;
+        st->len = st->pos - st->mark;
+        if(st->lowercaseMode) {
+            size_t i;
+            st->copy_len = 0;
+            if(!_st_copy(st, st->text, st->len))
                 goto error;
-            c = _st_get_char(st);
+            for(i = 0; i < st->len; i++)
+                st->copy[i] = tolower((unsigned char)st->copy[i]);
+            st->text = st->copy;
+        }
+        st->token = ST_WORD;
+        if(st->kw_table) {
+            int k = _st_find_keyword(st, st->text, st->len);
+            if(k >= 0)
+                st->token = ST_KEYWORD + k;
         }
-        st->value[st->p] = '\0';
-        st->token = ST_STRING;
-
-    } else if(st->quote_chars && strchr(st->quote_chars, c)) {
-        int term = c;
-        c = _st_get_char(st);
 
-        st->value[0] = '\0';
-        st->p = 0;
+    } else if(_ST_CLASS(st, c) & _ST_C_DIGIT) {
 
-        while(c != term) {
-            if(c == '\n') {
-                st->error_desc = "unterminated string constant";
-                goto error;
-            }
-            if(!_st_read_string_char(st, c))
-                goto error;
+        _st_scan_run(st, _ST_C_DIGIT);
+        c = _st_get_char(st);
+        if(c == '.') {
+            _st_scan_run(st, _ST_C_DIGIT);
             c = _st_get_char(st);
         }
-        st->value[st->p] = '\0';
+        if(c == 'e' || c == 'E') {
+            c = _st_get_char(st);
+            if(c != '+' && c != '-')
+                _st_unget_char(st, c);
+            _st_scan_run(st, _ST_C_DIGIT);
+            c = _st_get_char(st);
+        }
+        _st_unget_char(st, c);
+        st->text = st->mark;
+        st->len = st->pos - st->mark;
+        st->token = ST_NUMBER;
+
+    } else if(_ST_CLASS(st, c) & _ST_C_QUOTE) {
+
+        if(!_st_read_string(st, c, st->pos - st->mark))
+            goto error;
         st->token = ST_STRING;
 
-    } else if(st->operators && strchr(st->operators, c)) {
-        st->value[0] = c;
-        st->value[1] = '\0';
-        st->token = c;
     } else {
         st->error_desc = "unrecognised token";
         goto error;
     }
+    if(st->eof < 0)
+        goto error;
+    st->end_offset = _ST_OFFSET(st, st->pos);
     return st->token;
 
 eof:
+    if(st->eof < 0)
+        goto error;
+    st->offset = st->end_offset = _ST_OFFSET(st, st->pos);
     st->token = ST_EOF;
+    st_free(st);
+    st->text = "";
+    st->len = 0;
     return st->token;
 error:
+    st->end_offset = _ST_OFFSET(st, st->pos);
     st->token = ST_ERROR;
+    st_free(st);
+    st->text = "";
+    st->len = 0;
     return st->token;
 }
 
-#undef ST_APPEND
-
 #  endif /* STRMTOK_IMPLEMENTATION */
 
 #ifdef __cplusplus
@@ -705,6 +1465,8 @@ int main(int argc, char *argv[]) {
     StrmTok st;
     FILE *f = NULL;
     struct st_string_strm sts;
+    static const char *const keywords[] = {"foo", "fred", "if", "else", NULL};
+    static const char *const operators[] = {"<=", ">=", "==", "->", "::", NULL};
 
     if(argc > 1) {
         f = fopen(argv[1], "r");
@@ -732,6 +1494,9 @@ int main(int argc, char *argv[]) {
     st.operators = "[]+-:";
     st.word_chars = "$_";
 
+    st_keywords(&st, keywords);
+    st_operators(&st, operators);
+
     /*
     st.multi_comment_start = "--[[";
     st.multi_comment_end = "]]";
@@ -743,19 +1508,24 @@ int main(int argc, char *argv[]) {
                 printf("EOL\n");
                 break;
             case ST_WORD:
-                printf("word ......: %s\n", st.value);
+                printf("word ......: %.*s\n", (int)st.len, st.text);
                 break;
             case ST_STRING:
-                printf("string ....: '%s'\n", st.value);
+                printf("string ....: '%.*s'\n", (int)st.len, st.text);
                 break;
             case ST_NUMBER:
-                printf("number ....: %s\n", st.value);
+                printf("number ....: %s\n", st_value(&st));
                 break;
             case ST_ERROR:
                 fprintf(stderr, "error: %d: %s\n", st.lineno, st.error_desc);
                 return 1;
             default:
-                printf("operator ..: '%c'\n", st.token);
+                if(st.token >= ST_OPERATOR)
+                    printf("operator ..: '%s'\n", operators[st.token - ST_OPERATOR]);
+                else if(st.token >= ST_KEYWORD)
+                    printf("keyword ...: %s\n", keywords[st.token - ST_KEYWORD]);
+                else
+                    printf("operator ..: '%c'\n", st.token);
                 break;
         }
     }
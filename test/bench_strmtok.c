@@ -0,0 +1,190 @@
+/*
+ * Throughput benchmark for strmtok.h
+ *
+ * Generates source-like input (identifiers, keywords, numbers, strings,
+ * operators and comments) and tokenizes it from a string, from a `FILE`
+ * and through a custom `st_read_data_fun`, reporting tokens/s and MB/s.
+ *
+ * Usage: bench_strmtok [size-in-MB] [repeats]
+ *
+ * Compile with `-DST_READ_BUFFER_SIZE=n` to measure different block sizes,
+ * and with `-DST_STATS=1` to also report the profiling counters;
+ * `make bench` does both for several block sizes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STRMTOK_IMPLEMENTATION
+#include "../strmtok.h"
+
+static const char *const keywords[] = {"if", "else", "while", "return", "int", NULL};
+static const char *const operators[] = {"<=", ">=", "==", "!=", "->", "&&", "||", NULL};
+
+static const char *const idents[] = {
+    "foo", "bar_baz", "count", "x", "buffer_size", "if", "else", "while",
+    "return", "int", "_private", "CamelCase", "i", "j", "ptr2"
+};
+static const char *const ops[] = {
+    "+", "-", "*", "=", "(", ")", ";", ",", "<=", ">=", "==", "!=", "->", "&&", "||"
+};
+
+#define COUNT(a) (sizeof a / sizeof a[0])
+
+static char *generate(size_t size, size_t *len) {
+    char *text = malloc(size + 256), *p = text;
+    unsigned long seed = 12345;
+    if(!text)
+        return NULL;
+    while((size_t)(p - text) < size) {
+        unsigned int r;
+        seed = seed * 1103515245UL + 12345UL;
+        r = (unsigned int)(seed >> 16) & 0x7FFF;
+        switch(r % 16) {
+            case 0: case 1: case 2: case 3: case 4: case 5:
+                p += sprintf(p, "%s ", idents[r % COUNT(idents)]);
+                break;
+            case 6: case 7: case 8: case 9:
+                p += sprintf(p, "%s ", ops[r % COUNT(ops)]);
+                break;
+            case 10: case 11:
+                p += sprintf(p, "%u ", r);
+                break;
+            case 12:
+                p += sprintf(p, "%u.%02u ", r, r % 100);
+                break;
+            case 13:
+                p += sprintf(p, "\"string %u with some text\" ", r);
+                break;
+            case 14:
+                p += sprintf(p, "// line comment %u\n", r);
+                break;
+            default:
+                if(r & 0x100)
+                    p += sprintf(p, "/* block\n   comment %u */\n", r);
+                else
+                    p += sprintf(p, ";\n    ");
+                break;
+        }
+    }
+    *len = p - text;
+    return text;
+}
+
+struct mem_input {
+    const char *text;
+    size_t len, p;
+};
+
+static int mem_get_data(char *b, int n, void *d) {
+    struct mem_input *in = d;
+    size_t cnt = in->len - in->p;
+    if(cnt > (size_t)n)
+        cnt = n;
+    memcpy(b, in->text + in->p, cnt);
+    in->p += cnt;
+    return (int)cnt;
+}
+
+static long tokenize(StrmTok *st, const char *name) {
+    long count = 0;
+    st->operators = "+-*=();,";
+    st_keywords(st, keywords);
+    st_operators(st, operators);
+    while(st_next_token(st) != ST_EOF) {
+        if(st->token == ST_ERROR) {
+            fprintf(stderr, "%s: error: %d: %s\n", name, st->lineno, st->error_desc);
+            return -1;
+        }
+        count++;
+    }
+    return count;
+}
+
+static void report(const char *name, StrmTok *st, long tokens, size_t bytes, clock_t elapsed) {
+    double secs = (double)elapsed / CLOCKS_PER_SEC;
+    if(secs <= 0)
+        secs = 1.0 / CLOCKS_PER_SEC;
+    printf("%-8s %9ld tokens %8.3fs %12.0f tokens/s %8.1f MB/s\n", name,
+        tokens, secs, tokens / secs, bytes / secs / (1024.0 * 1024.0));
+#if ST_STATS
+    printf("         refills: %lu; grows: %lu; ungets: %lu; bytes: %lu; tokens: %lu\n",
+        st->stats.refills, st->stats.grows, st->stats.ungets, st->stats.bytes,
+        st->stats.tokens);
+#else
+    (void)st;
+#endif
+}
+
+int main(int argc, char *argv[]) {
+    StrmTok st;
+    size_t size = 8, len;
+    int i, repeats = 3;
+    char *text;
+    FILE *f;
+    clock_t start, elapsed;
+    long tokens;
+
+    if(argc > 1)
+        size = atoi(argv[1]);
+    if(argc > 2)
+        repeats = atoi(argv[2]);
+    if(size < 1)
+        size = 1;
+    if(repeats < 1)
+        repeats = 1;
+
+    text = generate(size << 20, &len);
+    if(!text) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    f = tmpfile();
+    if(!f || fwrite(text, 1, len, f) != len) {
+        fprintf(stderr, "unable to create temporary file\n");
+        return 1;
+    }
+
+    printf("ST_READ_BUFFER_SIZE: %d; input: %lu bytes\n", ST_READ_BUFFER_SIZE, (unsigned long)len);
+
+    for(i = 0; i < repeats; i++) {
+        struct st_string_strm sts;
+        struct mem_input in;
+
+        sts.str = text;
+        sts.len = (unsigned int)len;
+        start = clock();
+        st_init_string(&st, &sts);
+        tokens = tokenize(&st, "string");
+        elapsed = clock() - start;
+        if(tokens < 0)
+            return 1;
+        report("string", &st, tokens, len, elapsed);
+
+        rewind(f);
+        start = clock();
+        st_init_file(&st, f);
+        tokens = tokenize(&st, "file");
+        elapsed = clock() - start;
+        if(tokens < 0)
+            return 1;
+        report("file", &st, tokens, len, elapsed);
+
+        in.text = text;
+        in.len = len;
+        in.p = 0;
+        start = clock();
+        st_init_custom(&st, mem_get_data, &in);
+        tokens = tokenize(&st, "custom");
+        elapsed = clock() - start;
+        if(tokens < 0)
+            return 1;
+        report("custom", &st, tokens, len, elapsed);
+    }
+
+    fclose(f);
+    free(text);
+    return 0;
+}
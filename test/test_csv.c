@@ -1,7 +1,76 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "../csv.h"
 
+/* Saves `csv` as a columnar file, reads it back and checks that a
+ * truncated or corrupt copy of it can't be read out of bounds */
+static int test_columnar(csv_file *csv)
+{
+	csv_columnar *cc;
+	FILE *f;
+	long len, i;
+	int e, r, c;
+
+	if((e = csv_save_columnar(csv, "test.col", CSV_COLUMNAR_HEADER)) != 1)
+	{
+		fprintf(stderr, "Error: Couldn't save columnar file because %s\n", csv_errstr(e));
+		return 0;
+	}
+	if(!(cc = csv_open_columnar("test.col", &e)))
+	{
+		fprintf(stderr, "Error: Couldn't open columnar file because %s\n", csv_errstr(e));
+		return 0;
+	}
+	for(c = 0; c < csv_columnar_cols(cc); c++)
+		printf("column %d: %s, type %d\n", c, csv_columnar_name(cc, c), csv_columnar_type(cc, c));
+	for(r = 0; r < csv_columnar_rows(cc); r++)
+	{
+		for(c = 0; c < csv_columnar_cols(cc); c++)
+		{
+			if(csv_columnar_type(cc, c) == CSV_COL_STRING)
+				printf("|%s|", csv_columnar_string(cc, r, c));
+			else
+				printf("|%lld|", csv_columnar_int(cc, r, c));
+		}
+		printf("\n");
+	}
+	csv_close_columnar(cc);
+
+	/* Overwrite the second half of the file, which contains the strings'
+	 * offsets, with garbage */
+	if(!(f = fopen("test.col", "r+b")) || fseek(f, 0, SEEK_END) || (len = ftell(f)) < 0)
+		return 0;
+	fseek(f, len / 2, SEEK_SET);
+	for(i = len / 2; i < len; i++)
+		fputc(0x7F, f);
+	fclose(f);
+	if(!(cc = csv_open_columnar("test.col", &e)))
+		return 0;
+	for(r = 0, len = 0; r < csv_columnar_rows(cc); r++)
+		for(c = 0; c < csv_columnar_cols(cc); c++)
+			if(csv_columnar_type(cc, c) == CSV_COL_STRING)
+				len += strlen(csv_columnar_string(cc, r, c));
+	printf("corrupt: %ld bytes of strings\n", len);
+	csv_close_columnar(cc);
+
+	/* A truncated file is rejected */
+	if(!(f = fopen("test.col", "wb")))
+		return 0;
+	fputs("CSVCOL1", f);
+	fclose(f);
+	cc = csv_open_columnar("test.col", &e);
+	remove("test.col");
+	if(cc)
+	{
+		fprintf(stderr, "Error: Truncated columnar file was accepted\n");
+		csv_close_columnar(cc);
+		return 0;
+	}
+	printf("columnar: OK\n");
+	return 1;
+}
+
 int main(int argc, char *argv[])
 {	
 	csv_file *csv;
@@ -76,6 +145,9 @@ int main(int argc, char *argv[])
 		fprintf(stderr, "Error: Couldn't save CSV file because %s\n", csv_errstr(e));
 		return 1;
 	}
+
+	if(!test_columnar(csv))
+		return 1;
 		
 	csv_free(csv);
 	
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../csvsort.h"
+
+/*
+ * Sorts a CSV file and writes it to stdout:
+ *
+ *     test_csvsort [-h] [-m megabytes] [-t threads] file [column[n][r] ...]
+ *
+ * Each column to sort on may be followed by `n` to sort it as numbers
+ * and `r` to sort it in descending order, like `2nr`.
+ * `-h` treats the first record as a header.
+ */
+int main(int argc, char *argv[]) {
+    CsvSortOptions opt;
+    CsvSortKey *keys;
+    const char *file;
+    FILE *f;
+    int i, rv;
+
+    memset(&opt, 0, sizeof opt);
+    for(i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if(!strcmp(argv[i], "-h"))
+            opt.header = 1;
+        else if(!strcmp(argv[i], "-m") && i + 1 < argc)
+            opt.memory = (size_t)atoi(argv[++i]) << 20;
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc)
+            opt.threads = atoi(argv[++i]);
+        else
+            break;
+    }
+    if(i >= argc) {
+        fprintf(stderr, "usage: %s [-h] [-m megabytes] [-t threads] file [column[n][r] ...]\n", argv[0]);
+        return 1;
+    }
+
+    file = argv[i];
+    f = fopen(file, "r");
+    if(!f) {
+        fprintf(stderr, "Unable to open '%s': %s\n", file, strerror(errno));
+        return 1;
+    }
+
+    keys = calloc(argc, sizeof *keys);
+    if(!keys) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for(i++; i < argc; i++) {
+        char *p;
+        keys[opt.nkeys].column = (int)strtol(argv[i], &p, 10);
+        for(; *p; p++) {
+            if(*p == 'n')
+                keys[opt.nkeys].flags |= CSV_SORT_NUMERIC;
+            else if(*p == 'r')
+                keys[opt.nkeys].flags |= CSV_SORT_REVERSE;
+        }
+        opt.nkeys++;
+    }
+    opt.keys = keys;
+
+    rv = csv_sort(f, stdout, &opt);
+    if(rv != CSV_SORT_OK)
+        fprintf(stderr, "Unable to sort '%s': %s\n", file, csv_sort_errstr(rv));
+
+    free(keys);
+    fclose(f);
+    return rv != CSV_SORT_OK;
+}
@@ -1,10 +1,42 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 #define CSV_IMPLEMENTATION
 #include "../csvstrm.h"
 
+/* Indexes the file with an entry for every 4th record, and prints record `row` */
+static int print_row(const char *filename, unsigned long row) {
+    CsvContext csv;
+    CsvIndex idx;
+    int j;
+
+    if(!csv_build_index(filename, NULL, 4) || !csv_index_open(&idx, filename, NULL)) {
+        fprintf(stderr, "Unable to index '%s'\n", filename);
+        return 1;
+    }
+    printf("%lu records\n", csv_index_rows(&idx));
+    if(!csv_index_seek(&idx, &csv, row) || !csv_read_record(&csv)) {
+        fprintf(stderr, "Unable to read record %lu\n", row);
+        csv_index_close(&idx);
+        return 1;
+    }
+    printf("%lu:", row);
+    for(j = 0; j < csv_count(&csv); j++) {
+        printf("[%s]", csv_field(&csv,j));
+    }
+    printf("\n");
+    csv_index_close(&idx);
+    return 0;
+}
+
+/*
+ * Prints the records of a CSV file, or only record `row` through a row
+ * index (which is written to the file's name with ".idx" appended):
+ *
+ *     test_csvstrm file.csv [row]
+ */
 int main(int argc, char *argv[]) {
     CsvContext csv;
     FILE *f;
@@ -14,6 +46,9 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if(argc > 2)
+        return print_row(argv[1], strtoul(argv[2], NULL, 10));
+
     f = fopen(argv[1], "r");
     if(!f) {
         fprintf(stderr, "Unable to open '%s': %s\n", argv[1], strerror(errno));
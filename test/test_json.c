@@ -1,9 +1,169 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "../json.h"
 
+/* Projections only keep the paths that were found, and the objects leading to them */
+static int test_projection(void) {
+    const char *text = "{\"x\":{\"y\":5,\"w\":1},\"q\":{\"r\":3},\"a\":{\"b\":[1,{}]},"
+        "\"c\":{\"d\":{}},\"e\":2}";
+    const char *paths[] = {"x.y.z", "x.w", "q.r.s", "a.b", "c.d", "e.f"};
+    const char *expected = "{\"x\":{\"w\":1},\"a\":{\"b\":[1,{}]},\"c\":{\"d\":{}}}";
+    JSON *j = json_parse_projection(text, paths, 6);
+    char *s;
+    int ok;
+    if(!j)
+        return 0;
+    s = json_serialize(j);
+    ok = s && !strcmp(s, expected);
+    printf("projection: %s\n", s ? s : "(null)");
+    free(s);
+    json_release(j);
+    return ok;
+}
+
+/* The nesting of the text that test_schema() expects to be rejected */
+#define DEEP 1000000
+
+/* A schema with more properties in a nested object than fit in the initial tables */
+static int test_schema(void) {
+    const char *schema_text = "{\"type\":\"object\",\"properties\":{"
+        "\"id\":{\"type\":\"integer\"},"
+        "\"inner\":{\"type\":\"object\",\"required\":[\"p0\",\"p11\"],\"properties\":{"
+        "\"p0\":{\"type\":\"string\"},\"p1\":{\"type\":\"number\"},\"p2\":{},\"p3\":{},"
+        "\"p4\":{},\"p5\":{},\"p6\":{},\"p7\":{},\"p8\":{},\"p9\":{},\"p10\":{},"
+        "\"p11\":{\"type\":\"integer\",\"maximum\":10}}}}}";
+    const char *good = "{\"id\":1,\"inner\":{\"p0\":\"a\",\"p1\":2.5,\"p11\":10}}";
+    const char *bad = "{\"id\":1,\"inner\":{\"p0\":\"a\",\"p11\":11}}";
+    JSON *j = json_parse(schema_text);
+    JSON_Schema *s;
+    char *deep;
+    int ok;
+    if(!j)
+        return 0;
+    s = json_schema_compile(j);
+    json_release(j);
+    if(!s)
+        return 0;
+    ok = json_schema_validate_text(s, good) && !json_schema_validate_text(s, bad);
+    /* Deeply nested text must be rejected, not overflow the stack */
+    deep = malloc(DEEP + 6);
+    if(deep) {
+        strcpy(deep, "{\"x\":");
+        memset(deep + 5, '[', DEEP);
+        deep[DEEP + 5] = '\0';
+        ok = ok && !json_schema_validate_text(s, deep);
+        free(deep);
+    }
+    ok = ok && !json_schema_validate_text(s, "");
+    printf("schema: %s\n", ok ? "OK" : "failed");
+    json_schema_free(s);
+    return ok;
+}
+
+/* Minifies `text`; returns the output, or NULL if it was rejected */
+static char *minify(const char *text) {
+    static char out[256];
+    FILE *in = tmpfile(), *o = tmpfile();
+    size_t n = 0;
+    int ok;
+    if(!in || !o)
+        return NULL;
+    fputs(text, in);
+    rewind(in);
+    ok = json_reformat(in, o, JSON_REFORMAT_MINIFY);
+    if(ok) {
+        rewind(o);
+        n = fread(out, 1, sizeof out - 1, o);
+    }
+    out[n] = '\0';
+    fclose(in);
+    fclose(o);
+    return ok ? out : NULL;
+}
+
+/* The reformatter must reject structural errors rather than run tokens together */
+static int test_reformat(void) {
+    static const char *bad[] = {
+        "[1 2 3]", "[true false]", "{\"x\" \"y\"}", "{\"a\":1]", "[1,]", "{\"a\":}",
+        "{1:2}", "[1:2]", "[,1]", "{\"a\",1}", "[nope]", "[1", "]"
+    };
+    const char *text = "{ \"a\" : [1, 2.5, -3e2, true, null, {}, []], \"b\" : {\"c\" : \"d\"} } [false]";
+    const char *expected = "{\"a\":[1,2.5,-3e2,true,null,{},[]],\"b\":{\"c\":\"d\"}}\n[false]\n";
+    char *s;
+    size_t i;
+    int ok = 1;
+    for(i = 0; i < sizeof bad / sizeof bad[0]; i++) {
+        if(minify(bad[i])) {
+            fprintf(stderr, "reformat: accepted %s\n", bad[i]);
+            ok = 0;
+        }
+    }
+    s = minify(text);
+    if(!s || strcmp(s, expected))
+        ok = 0;
+    printf("reformat: %s\n", ok ? "OK" : "failed");
+    return ok;
+}
+
+/* Retrieving an element of a packed array must not unpack the rest of it */
+static int test_packed(void) {
+    JSON *j = json_parse("[1,2.5,3]");
+    const double *d;
+    JSON *v;
+    char *s;
+    int ok;
+    if(!j)
+        return 0;
+    v = json_array_get(j, 1);
+    ok = v && json_as_number(v) == 2.5 && json_array_get(j, 1) == v;
+    d = json_array_numbers(j);
+    ok = ok && d && d[0] == 1 && d[1] == 2.5 && d[2] == 3;
+    json_array_add_number(j, 4);
+    d = json_array_numbers(j);
+    ok = ok && d && d[3] == 4 && json_as_number(json_array_get(j, 3)) == 4;
+    json_array_add_string(j, "five");
+    ok = ok && !json_array_numbers(j) && json_array_get(j, 1) == v;
+    s = json_serialize(j);
+    ok = ok && s && !strcmp(s, "[1,2.5,3,4,\"five\"]");
+    printf("packed: %s\n", ok ? "OK" : "failed");
+    free(s);
+    json_release(j);
+    return ok;
+}
+
+/* Copy-on-write updates must leave the template intact and share the untouched parts */
+static int test_cow(void) {
+    const char *text = "{\"a\":{\"list\":[{\"k\":1},{\"k\":2}],\"n\":[1,2]},\"b\":{\"c\":3}}";
+    JSON *tpl = json_parse(text), *doc;
+    char *s;
+    int ok;
+    if(!tpl)
+        return 0;
+    doc = json_retain(tpl);
+    /* A bad index must not modify anything */
+    doc = json_set_path_cow(doc, "a.list.5.k", json_new_number(9));
+    ok = (doc == tpl);
+    doc = json_set_path_cow(doc, "a.list.0.k", json_new_number(9));
+    doc = json_set_path_cow(doc, "a.n.1", json_new_number(5));
+    ok = ok && doc != tpl
+        && json_obj_get(doc, "b") == json_obj_get(tpl, "b")
+        && json_array_get(json_obj_get(json_obj_get(doc, "a"), "list"), 1)
+            == json_array_get(json_obj_get(json_obj_get(tpl, "a"), "list"), 1);
+    s = json_serialize(tpl);
+    ok = ok && s && !strcmp(s, text);
+    free(s);
+    s = json_serialize(doc);
+    ok = ok && s && !strcmp(s, "{\"a\":{\"list\":[{\"k\":9},{\"k\":2}],\"n\":[1,5]},\"b\":{\"c\":3}}");
+    free(s);
+    printf("copy-on-write: %s\n", ok ? "OK" : "failed");
+    json_release(doc);
+    json_release(tpl);
+    return ok;
+}
+
 int main(int argc, char *argv[]) {
     JSON *j;
 
@@ -77,6 +237,27 @@ int main(int argc, char *argv[]) {
 
 	json_release(j);
 
+    if(!test_projection()) {
+        json_error("projection failed");
+        return 1;
+    }
+    if(!test_schema()) {
+        json_error("schema failed");
+        return 1;
+    }
+    if(!test_packed()) {
+        json_error("packed arrays failed");
+        return 1;
+    }
+    if(!test_cow()) {
+        json_error("copy-on-write failed");
+        return 1;
+    }
+    if(!test_reformat()) {
+        json_error("reformat failed");
+        return 1;
+    }
+
 #if 0
     j = json_new_array();
     json_array_add(j,json_null());
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "../json.h"
+#include "../jsoncsv.h"
+
+/*
+ * Converts a JSON Lines file to CSV, or a CSV file to JSON Lines (with -j):
+ *
+ *     test_jsoncsv file.jsonl [field ...]
+ *     test_jsoncsv -j file.csv
+ */
+int main(int argc, char *argv[]) {
+    FILE *f;
+    int ok;
+
+    if(argc < 2) {
+        fprintf(stderr, "usage: %s [-j] file [field ...]\n", argv[0]);
+        return 1;
+    }
+
+    if(!strcmp(argv[1], "-j")) {
+        if(argc < 3) {
+            fprintf(stderr, "CSV file expected\n");
+            return 1;
+        }
+        f = fopen(argv[2], "r");
+        if(!f) {
+            fprintf(stderr, "Unable to open '%s': %s\n", argv[2], strerror(errno));
+            return 1;
+        }
+        ok = csv_to_json_lines(f, stdout, JSONCSV_NUMBERS);
+    } else {
+        f = fopen(argv[1], "r");
+        if(!f) {
+            fprintf(stderr, "Unable to open '%s': %s\n", argv[1], strerror(errno));
+            return 1;
+        }
+        /* Use the fields named on the command line, or the keys of the first object */
+        if(argc > 2)
+            ok = json_lines_to_csv(f, stdout, (const char **)argv + 2, argc - 2);
+        else
+            ok = json_lines_to_csv(f, stdout, NULL, 0);
+    }
+
+    fclose(f);
+    return !ok;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+
+#define STRMTOK_IMPLEMENTATION
+#include "../strmtok.h"
+
+/*
+ * Checks the line and column of each token of a small input with
+ * `significantEol` on, through a string and through a custom reader
+ * that returns one byte at a time, and checks that large sets of
+ * operators and keywords, which do not fit inside the `StrmTok`,
+ * are still recognised, and that operators made of letters don't
+ * split words.
+ */
+
+struct expected {
+    int token, line, column;
+};
+
+static const char *const input = "foo bar\n  baz\n\nqux 12\n";
+
+static const struct expected tokens[] = {
+    {ST_WORD, 1, 1}, {ST_WORD, 1, 5}, {ST_EOL, 1, 8},
+    {ST_WORD, 2, 3}, {ST_EOL, 2, 6},
+    {ST_EOL, 3, 1},
+    {ST_WORD, 4, 1}, {ST_NUMBER, 4, 5}, {ST_EOL, 4, 7},
+    {ST_EOF, 5, 1}
+};
+
+static int one_byte(char *b, int n, void *d) {
+    const char **p = d;
+    (void)n;
+    if(!**p)
+        return 0;
+    *b = *(*p)++;
+    return 1;
+}
+
+static int check(StrmTok *st, const char *name) {
+    size_t i;
+    st->significantEol = 1;
+    for(i = 0; i < sizeof tokens / sizeof tokens[0]; i++) {
+        int t = st_next_token(st);
+        if(t != tokens[i].token || st->line != tokens[i].line || st->column != tokens[i].column) {
+            fprintf(stderr, "%s: token %d: got %d at %d:%d, expected %d at %d:%d\n", name, (int)i,
+                t, st->line, st->column, tokens[i].token, tokens[i].line, tokens[i].column);
+            return 0;
+        }
+    }
+    printf("%s: OK\n", name);
+    return 1;
+}
+
+/* Registers 100 keywords "k0".."k99" and 50 operators "@0".."@49" */
+static int check_large(void) {
+    static char names[150][8];
+    const char *keywords[101], *operators[51];
+    struct st_string_strm sts;
+    StrmTok st;
+    int i, t[4];
+
+    for(i = 0; i < 100; i++) {
+        sprintf(names[i], "k%d", i);
+        keywords[i] = names[i];
+    }
+    keywords[100] = NULL;
+    for(i = 0; i < 50; i++) {
+        sprintf(names[100 + i], "@%d", i);
+        operators[i] = names[100 + i];
+    }
+    operators[50] = NULL;
+
+    sts.str = "k42 @17 k99 @0";
+    sts.len = (unsigned int)strlen(sts.str);
+    st_init_string(&st, &sts);
+    st.operators = "@";
+    if(!st_keywords(&st, keywords) || !st_operators(&st, operators)) {
+        fprintf(stderr, "large: %s\n", st.error_desc);
+        return 0;
+    }
+    for(i = 0; i < 4; i++)
+        t[i] = st_next_token(&st);
+    if(t[0] != ST_KEYWORD + 42 || t[1] != ST_OPERATOR + 17 || t[2] != ST_KEYWORD + 99
+        || t[3] != ST_OPERATOR + 0 || st_next_token(&st) != ST_EOF) {
+        fprintf(stderr, "large: unexpected tokens %d %d %d %d\n", t[0], t[1], t[2], t[3]);
+        return 0;
+    }
+    printf("large: OK\n");
+    return 1;
+}
+
+/* Operators that end in a word character must not split words */
+static int check_word_operators(void) {
+    static const char *const operators[] = {"and", "or", NULL};
+    static const int expected[] = {
+        ST_WORD, ST_NUMBER, ST_WORD, ST_WORD, ST_OPERATOR + 0, ST_WORD, ST_OPERATOR + 1, ST_EOF
+    };
+    const char *p = "android 1or2 a and b or";
+    StrmTok st;
+    size_t i;
+
+    st_init_custom(&st, one_byte, &p);
+    if(!st_operators(&st, operators)) {
+        fprintf(stderr, "word operators: %s\n", st.error_desc);
+        return 0;
+    }
+    for(i = 0; i < sizeof expected / sizeof expected[0]; i++) {
+        int t = st_next_token(&st);
+        if(t != expected[i]) {
+            fprintf(stderr, "word operators: token %d: got %d, expected %d\n", (int)i, t, expected[i]);
+            st_free(&st);
+            return 0;
+        }
+    }
+    st_free(&st);
+    printf("word operators: OK\n");
+    return 1;
+}
+
+int main(void) {
+    StrmTok st;
+    struct st_string_strm sts;
+    const char *p = input;
+    int ok;
+
+    sts.str = input;
+    sts.len = (unsigned int)strlen(input);
+    st_init_string(&st, &sts);
+    ok = check(&st, "string");
+
+    st_init_custom(&st, one_byte, &p);
+    ok = check(&st, "custom") && ok;
+
+    ok = check_large() && ok;
+    ok = check_word_operators() && ok;
+
+    return !ok;
+}
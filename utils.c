@@ -9,13 +9,149 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <ctype.h>
+
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#  define MY_POSIX_IO 1
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#endif
+
+#include "utils.h"
+
+/* ASCII case folding tables; see MY_TOLOWER() and MY_TOUPPER() */
+const unsigned char my_lower_tab[256] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+    0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F,
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+    0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
+    0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF,
+    0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF,
+    0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
+};
+
+const unsigned char my_upper_tab[256] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+    0x60, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F,
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
+    0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+    0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
+    0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF,
+    0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF,
+    0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF
+};
 
 /* Case insensitive strcmp()
  */
 int my_stricmp(const char *p, const char *q) {
-    for(;*p && tolower(*p) == tolower(*q); p++, q++);
-    return tolower(*p) - tolower(*q);
+    for(;*p && MY_TOLOWER(*p) == MY_TOLOWER(*q); p++, q++);
+    return MY_TOLOWER(*p) - MY_TOLOWER(*q);
+}
+
+/* Word-at-a-time helpers: MY_ONES has 0x01 in every byte of a word,
+ * MY_HIGHS 0x80 in every byte. fold_word() converts the ASCII upper case
+ * letters in a word to lower case without looking at the bytes one by one:
+ * adding (0x80 - 'A') to the low 7 bits of each byte sets its high bit if
+ * the byte is >= 'A', and adding (0x80 - 'Z' - 1) sets it if the byte > 'Z'.
+ */
+#define MY_ONES     (((size_t)-1) / 0xFF)
+#define MY_HIGHS    (MY_ONES * 0x80)
+
+static size_t fold_word(size_t w) {
+    size_t low = w & ~MY_HIGHS;
+    size_t ge_a = low + MY_ONES * (0x80 - 'A');
+    size_t gt_z = low + MY_ONES * (0x80 - 'Z' - 1);
+    return w | (((ge_a & ~gt_z & ~w) & MY_HIGHS) >> 2);
+}
+
+/* Case insensitive memcmp() */
+int my_memicmp(const void *p, const void *q, size_t n) {
+    const unsigned char *a = p, *b = q;
+    size_t wa, wb;
+    while(n >= sizeof wa) {
+        memcpy(&wa, a, sizeof wa);
+        memcpy(&wb, b, sizeof wb);
+        if(wa != wb && fold_word(wa) != fold_word(wb))
+            break;
+        a += sizeof wa;
+        b += sizeof wb;
+        n -= sizeof wa;
+    }
+    for(; n; a++, b++, n--) {
+        if(MY_TOLOWER(*a) != MY_TOLOWER(*b))
+            return MY_TOLOWER(*a) - MY_TOLOWER(*b);
+    }
+    return 0;
+}
+
+my_slice my_slice_of(const char *s) {
+    my_slice sl;
+    sl.s = s;
+    sl.len = strlen(s);
+    return sl;
+}
+
+my_slice my_slice_n(const char *s, size_t len) {
+    my_slice sl;
+    sl.s = s;
+    sl.len = len;
+    return sl;
+}
+
+int my_slice_icmp(my_slice a, my_slice b) {
+    int c = my_memicmp(a.s, b.s, MY_MIN(a.len, b.len));
+    if(c)
+        return c;
+    return a.len < b.len ? -1 : a.len > b.len;
+}
+
+int my_slice_ieq(my_slice a, my_slice b) {
+    return a.len == b.len && !my_memicmp(a.s, b.s, a.len);
+}
+
+char *my_slice_dup(my_slice a) {
+    char *s = malloc(a.len + 1);
+    if(!s) return NULL;
+    memcpy(s, a.s, a.len);
+    s[a.len] = '\0';
+    return s;
+}
+
+/* 32-bit FNV-1a */
+unsigned int my_hash(const char *s, size_t len) {
+    unsigned int h = 2166136261u;
+    const unsigned char *p = (const unsigned char *)s, *end = p + len;
+    for(; p < end; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+unsigned int my_ihash(const char *s, size_t len) {
+    unsigned int h = 2166136261u;
+    const unsigned char *p = (const unsigned char *)s, *end = p + len;
+    for(; p < end; p++)
+        h = (h ^ MY_TOLOWER(*p)) * 16777619u;
+    return h;
 }
 
 /* strdup() is not ANSI C */
@@ -32,7 +168,7 @@ char *my_strdup(const char *s) {
 char *my_strlower (char *p) {
   char *s;
   for (s = p; s[0]; s++)
-    s[0] = tolower (s[0]);
+    s[0] = MY_TOLOWER (s[0]);
 
   return p;
 }
@@ -42,7 +178,7 @@ char *my_strupper (char *p)
 {
   char *s;
   for (s = p; s[0]; s++)
-    s[0] = toupper (s[0]);
+    s[0] = MY_TOUPPER (s[0]);
 
   return p;
 }
@@ -66,31 +202,167 @@ char *my_strtok_r(char *str, const char *delim, char **saveptr) {
     return str;
 }
 
-/* Reads an entire file into a dynamically allocated memory buffer.
- * The returned buffer needs to be free()d afterwards
+/* Size of the chunks in which files of unknown size are read */
+#define MY_READ_CHUNK   65536
+
+/* Grows the buffer `*buf` of `*cap` bytes so that there is space for at least
+ * one more byte and a null terminator after its first `len` bytes.
  */
-char *my_readfile(const char *fname) {
-    FILE *f;
-    long len,r;
-    char *str;
+static int grow_buffer(char **buf, size_t *cap, size_t len) {
+    char *nb;
+    size_t ncap;
+    if(*cap - len >= 2)
+        return 1;
+    ncap = *cap ? *cap << 1 : MY_READ_CHUNK;
+    if(ncap <= *cap || !(nb = realloc(*buf, ncap)))
+        return 0;
+    *buf = nb;
+    *cap = ncap;
+    return 1;
+}
 
-    if(!(f = fopen(fname, "rb")))
+#ifdef MY_POSIX_IO
+
+/* Reads everything from `fd`. `hint` is the expected size, or 0 if unknown */
+static char *read_fd(int fd, size_t hint, my_filebuf *fb) {
+    char *buf = NULL;
+    size_t cap = hint ? hint + 2 : 0, len = 0;
+    ssize_t r;
+
+    if(cap && !(buf = malloc(cap)))
         return NULL;
+    for(;;) {
+        if(!grow_buffer(&buf, &cap, len))
+            goto error;
+        r = read(fd, buf + len, cap - len - 1);
+        if(r < 0) {
+            if(errno == EINTR)
+                continue;
+            goto error;
+        }
+        if(r == 0)
+            break;
+        len += r;
+    }
+    buf[len] = '\0';
+    fb->data = buf;
+    fb->len = len;
+    fb->map_len = 0;
+    return buf;
+error:
+    free(buf);
+    return NULL;
+}
+
+char *my_loadfile(const char *fname, my_filebuf *fb, int flags) {
+    struct stat st;
+    char *data = NULL;
+    int fd;
 
-    fseek(f, 0, SEEK_END);
-    len = ftell(f);
-    rewind(f);
+    fb->data = NULL;
+    fb->len = fb->map_len = 0;
 
-    if(!(str = malloc(len+2)))
+    if((fd = open(fname, O_RDONLY)) < 0)
         return NULL;
-    r = fread(str, 1, len, f);
 
-    if(r != len) {
-        free(str);
+    if(fstat(fd, &st) < 0) {
+        close(fd);
         return NULL;
     }
 
+    if(S_ISREG(st.st_mode) && (off_t)(size_t)st.st_size == st.st_size) {
+        size_t len = st.st_size;
+        long page = sysconf(_SC_PAGESIZE);
+
+        /* The mapping ends in the middle of a page unless the size is an
+        exact multiple of the page size, so there is room for the terminator.
+        The bytes after the end of the file are only zero while the file does
+        not grow, so the terminator is written explicitly; the mapping is
+        private, so this copies that one page rather than changing the file. */
+        if(!(flags & MY_LOAD_NOMAP) && len > 0 && page > 0 && len % page) {
+            void *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if(m != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+                if(flags & MY_LOAD_SEQUENTIAL)
+                    madvise(m, len, MADV_SEQUENTIAL);
+#endif
+                close(fd);
+                fb->data = m;
+                fb->data[len] = '\0';
+                fb->len = fb->map_len = len;
+                return fb->data;
+            }
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        if(flags & MY_LOAD_SEQUENTIAL)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        data = read_fd(fd, len, fb);
+    } else {
+        data = read_fd(fd, 0, fb);
+    }
+
+    close(fd);
+    return data;
+}
+
+void my_freefile(my_filebuf *fb) {
+    if(fb->map_len)
+        munmap(fb->data, fb->map_len);
+    else
+        free(fb->data);
+    fb->data = NULL;
+    fb->len = fb->map_len = 0;
+}
+
+#else
+
+char *my_loadfile(const char *fname, my_filebuf *fb, int flags) {
+    FILE *f;
+    char *buf = NULL;
+    size_t cap = 0, len = 0, r;
+
+    (void)flags;
+    fb->data = NULL;
+    fb->len = fb->map_len = 0;
+
+    if(!(f = fopen(fname, "rb")))
+        return NULL;
+
+    for(;;) {
+        if(!grow_buffer(&buf, &cap, len))
+            goto error;
+        r = fread(buf + len, 1, cap - len - 1, f);
+        len += r;
+        if(r == 0) {
+            if(ferror(f))
+                goto error;
+            break;
+        }
+    }
     fclose(f);
-    str[len] = '\0';
-    return str;
+    buf[len] = '\0';
+    fb->data = buf;
+    fb->len = len;
+    return buf;
+error:
+    fclose(f);
+    free(buf);
+    return NULL;
+}
+
+void my_freefile(my_filebuf *fb) {
+    free(fb->data);
+    fb->data = NULL;
+    fb->len = fb->map_len = 0;
+}
+
+#endif
+
+/* Reads an entire file into a dynamically allocated memory buffer.
+ * The returned buffer needs to be free()d afterwards
+ */
+char *my_readfile(const char *fname) {
+    my_filebuf fb;
+    return my_loadfile(fname, &fb, MY_LOAD_NOMAP);
 }
@@ -14,6 +14,10 @@
  * ## API
  * ### Macros
  */
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <stddef.h>
 
 /**
  * #### `MY_MIN(a,b)`
@@ -31,6 +35,64 @@
  */
 #define MY_MAX(a,b) (((a)>(b))?(a):(b))
 
+/**
+ * #### `MY_TOLOWER(c)` and `MY_TOUPPER(c)`
+ * Macros that convert a character `c` to lower or upper case through the
+ * `my_lower_tab` and `my_upper_tab` tables.
+ *
+ * Unlike `tolower()` and `toupper()` from `<ctype.h>` they only fold the
+ * ASCII letters and are not affected by the locale, which makes them cheap
+ * enough to use in string comparisons.
+ */
+#define MY_TOLOWER(c) (my_lower_tab[(unsigned char)(c)])
+#define MY_TOUPPER(c) (my_upper_tab[(unsigned char)(c)])
+
+extern const unsigned char my_lower_tab[256];
+extern const unsigned char my_upper_tab[256];
+
+/**
+ * ### Types
+ *
+ * #### `my_slice`
+ * A string slice: a pointer `s` to `len` characters that need not be
+ * null-terminated. Keeping the length with the string means that it only
+ * has to be computed once, and that slices of a larger buffer can be
+ * compared without copying them.
+ *
+ * ```
+ * typedef struct my_slice {
+ *     const char *s;
+ *     size_t len;
+ * } my_slice;
+ * ```
+ */
+typedef struct my_slice {
+    const char *s;
+    size_t len;
+} my_slice;
+
+/**
+ * #### `my_filebuf`
+ * The contents of a file loaded by `my_loadfile()`.
+ *
+ * ```
+ * typedef struct my_filebuf {
+ *     char *data;
+ *     size_t len;
+ *     size_t map_len;
+ * } my_filebuf;
+ * ```
+ *
+ * `data` points to the `len` bytes of the file, followed by a `'\0'`.
+ * `map_len` is non-zero if `data` was mapped into memory with `mmap()`
+ * rather than allocated with `malloc()`.
+ */
+typedef struct my_filebuf {
+    char *data;
+    size_t len;
+    size_t map_len;
+} my_filebuf;
+
 /**
  * ### Functions
  */
@@ -43,6 +105,67 @@
  */
 int my_stricmp(const char *p, const char *q);
 
+/**
+ * #### `int my_memicmp(const void *p, const void *q, size_t n)`
+ * Compares the first `n` characters of `p` and `q` case insensitively,
+ * returning 0, a positive or a negative number like `my_stricmp()`.
+ *
+ * It compares a machine word at a time, and only folds the case of
+ * words that differ.
+ */
+int my_memicmp(const void *p, const void *q, size_t n);
+
+/**
+ * #### `my_slice my_slice_of(const char *s)`
+ * Returns a `my_slice` of the null-terminated string `s`.
+ */
+my_slice my_slice_of(const char *s);
+
+/**
+ * #### `my_slice my_slice_n(const char *s, size_t len)`
+ * Returns a `my_slice` of the `len` characters at `s`.
+ */
+my_slice my_slice_n(const char *s, size_t len);
+
+/**
+ * #### `int my_slice_icmp(my_slice a, my_slice b)`
+ * Compares the slices `a` and `b` case insensitively, returning 0,
+ * a positive or a negative number like `my_stricmp()`.
+ */
+int my_slice_icmp(my_slice a, my_slice b);
+
+/**
+ * #### `int my_slice_ieq(my_slice a, my_slice b)`
+ * Returns non-zero if the slices `a` and `b` are equal, ignoring case.
+ *
+ * Slices of different lengths are rejected without looking at their characters.
+ */
+int my_slice_ieq(my_slice a, my_slice b);
+
+/**
+ * #### `char *my_slice_dup(my_slice a)`
+ * Copies the slice `a` to a null-terminated string in a dynamic
+ * memory buffer, which needs to be `free()`d after use.
+ *
+ * It returns `NULL` if the memory allocation fails.
+ */
+char *my_slice_dup(my_slice a);
+
+/**
+ * #### `unsigned int my_hash(const char *s, size_t len)`
+ * Computes a hash of the `len` characters at `s`.
+ *
+ * It uses the 32-bit FNV-1a hash function.
+ */
+unsigned int my_hash(const char *s, size_t len);
+
+/**
+ * #### `unsigned int my_ihash(const char *s, size_t len)`
+ * Computes a case insensitive hash of the `len` characters at `s`:
+ * Strings that `my_memicmp()` considers equal have the same hash.
+ */
+unsigned int my_ihash(const char *s, size_t len);
+
 /**
  * #### `char *my_strdup(const char *s)`
  * Creates a duplicate of a string `s` in a dynamic memory buffer.
@@ -77,5 +200,46 @@ char *my_strtok_r(char *str, const char *delim, char **saveptr);
  * Reads an entire file identified by `fn` into a dynamically allocated memory buffer.\n
  * The returned buffer needs to be `free()`d afterwards.\n
  * It returns `NULL` if the file could not be read.
+ *
+ * It does not need to seek, so `fn` may also be a pipe or `/dev/stdin`.
  */
 char *my_readfile (const char *fn);
+
+/**
+ * #### `char *my_loadfile(const char *fn, my_filebuf *fb, int flags)`
+ * Loads an entire file identified by `fn` into memory, describing it in `fb`.
+ * It returns `fb->data`, which is null-terminated, or `NULL` if the file
+ * could not be read.
+ *
+ * On POSIX systems, regular files are mapped into memory with `mmap()`, so
+ * that they are not copied at all. Pipes and other files that can't be
+ * mapped are read into a buffer that grows in large chunks.
+ * The data is mapped privately, so it can be modified without affecting
+ * the file.
+ *
+ * A mapped file must not be modified by other processes while it is loaded:
+ * changes made to the file may or may not show up in `fb->data`, and if the
+ * file is truncated, reading the part that was cut off raises `SIGBUS`.
+ * Use `MY_LOAD_NOMAP` for files that may change. The terminator after the
+ * `fb->len` bytes is always there, even if the file grows.
+ *
+ * `flags` is a combination of
+ *
+ * * `MY_LOAD_SEQUENTIAL` - Advise the OS that the file will be read
+ *   sequentially, through `posix_fadvise()` or `madvise()`.
+ * * `MY_LOAD_NOMAP` - Always read the file into a `malloc()`ed buffer.
+ *
+ * Call `my_freefile()` to release the memory afterwards.
+ */
+#define MY_LOAD_SEQUENTIAL  0x01
+#define MY_LOAD_NOMAP       0x02
+
+char *my_loadfile(const char *fn, my_filebuf *fb, int flags);
+
+/**
+ * #### `void my_freefile(my_filebuf *fb)`
+ * Releases the memory of a file loaded with `my_loadfile()`.
+ */
+void my_freefile(my_filebuf *fb);
+
+#endif /* UTILS_H */